@@ -0,0 +1,225 @@
+/*
+// Per-stage benchmark of the converter on a synthetic GnssLogger log (log_gen.h).
+// Each stage runs on the output of the previous one, and is reported in rows/s,
+// MB/s and the peak resident memory reached during the stage:
+//   parse     Raw lines to the columnar obs_table
+//   classify  signal classification (classify_signal)
+//   convert   epoch grouping and observables (conv_rows / start_epoch)
+//   write     RINEX records through the buffered writer (MB/s of RINEX output)
+// followed by the whole conversion of the log from a file, serial and parallel.
+// MB/s of the first three stages refers to the size of the log text.
+//
+// Build from this directory together with the converter sources, e.g.
+//   cl /O2 /EHsc /std:c++17 bench_stages.cpp log_gen.cpp ..\rnx_conv.cpp ..\rnx_write.cpp ..\rnx_par.cpp ..\obs_table.cpp ..\obs_cache.cpp ..\conv_stats.cpp ..\obs_kernel.cpp ..\conv_filter.cpp ..\epoch_index.cpp ..\rnx_nav.cpp ..\fix_csv.cpp ..\log_reader.cpp ..\thread_pool.cpp psapi.lib
+//   g++ -O2 -std=c++17 -pthread bench_stages.cpp log_gen.cpp ../rnx_conv.cpp ../rnx_write.cpp ../rnx_par.cpp ../obs_table.cpp ../obs_cache.cpp ../conv_stats.cpp ../obs_kernel.cpp ../conv_filter.cpp ../epoch_index.cpp ../rnx_nav.cpp ../fix_csv.cpp ../log_reader.cpp ../thread_pool.cpp
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#include "../rnx_conv.h"
+#include "../thread_pool.h"
+#include "log_gen.h"
+
+#define BENCH_LOG "bench_stages_log.txt"  /* Log written for the whole conversion */
+
+// Start a new peak of the resident memory where the system allows it (Linux)
+static void reset_peak_rss()
+{
+#ifdef __linux__
+	FILE* fp = fopen("/proc/self/clear_refs", "w");
+	if (fp) {
+		fputs("5", fp);
+		fclose(fp);
+	}
+#endif
+}
+
+// Peak resident memory in MB, since the last reset_peak_rss() on Linux and
+// since the start of the process elsewhere
+static double peak_rss_mb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize / 1048576.0;
+#elif defined(__linux__)
+	FILE* fp = fopen("/proc/self/status", "r");
+	char line[256];
+	double kb = 0;
+	while (fp && fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, "VmHWM:", 6)) kb = atof(line + 6);
+	}
+	if (fp) fclose(fp);
+	return kb / 1024.0;
+#endif
+	return 0.0;
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void report(const char* stage, double sec, size_t rows, size_t bytes)
+{
+	printf("  %-10s %8.1f ms %8.2f Mrows/s %8.1f MB/s %8.1f MB peak\n", stage, sec * 1e3,
+		rows / sec / 1e6, bytes / sec / 1048576.0, peak_rss_mb());
+}
+
+static void print_usage()
+{
+	printf("usage: bench_stages [-d seconds] [-r ms] [-s GREJC] [-1] [-j threads] [-S seed] [-k kernel]\n");
+	printf("  -d seconds  length of the synthetic log (default 7200)\n");
+	printf("  -r ms       epoch interval (default 1000)\n");
+	printf("  -s systems  constellations: G GPS, R GLONASS, E Galileo, C BeiDou, J QZSS (default GREJC)\n");
+	printf("  -1          single frequency only\n");
+	printf("  -j threads  threads of the parallel conversion (default 4)\n");
+	printf("  -S seed     random seed (default 1)\n");
+	printf("  -k kernel   observables kernel: avx512, avx2 or scalar (default: best supported)\n");
+}
+
+int main(int argc, char** argv)
+{
+	gen_opt gopt;
+	gopt.duration_s = 7200;
+	int nthreads = 4;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-d") && i + 1 < argc) gopt.duration_s = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) gopt.rate_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			const char* s = argv[++i];
+			gopt.systems = (strchr(s, 'G') ? GEN_GPS : 0) | (strchr(s, 'R') ? GEN_GLO : 0) |
+				(strchr(s, 'E') ? GEN_GAL : 0) | (strchr(s, 'C') ? GEN_BDS : 0) | (strchr(s, 'J') ? GEN_QZS : 0);
+		}
+		else if (!strcmp(argv[i], "-1")) gopt.dual_freq = false;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc) nthreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-S") && i + 1 < argc) gopt.seed = strtoull(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc) {
+			if (!set_obs_kernel(argv[++i])) {
+				fprintf(stderr, "Kernel %s is not available\n", argv[i]);
+				return 1;
+			}
+		}
+		else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	// Log in memory
+	gen_state g;
+	gen_init(&g, &gopt);
+	std::string log;
+	gen_header(&log);
+	while (gen_epoch(&g, &log)) ;
+	printf("Synthetic log: %d epochs, %.1f MB, %s kernel\n", g.epoch, log.size() / 1048576.0, obs_kernel_name());
+
+	// Parse
+	reset_peak_rss();
+	auto t0 = std::chrono::steady_clock::now();
+	obs_table t;
+	log_reader rd;
+	log_open_mem(&rd, log.data(), log.size());
+	const char* line = NULL;
+	size_t len = 0;
+	while (log_next_line(&rd, &line, &len)) {
+		if (len < 4 || memcmp(line, "Raw,", 4) != 0) continue;
+		t.add_row(line, line + len);
+	}
+	size_t nrows = t.size();
+	printf("%zu Raw rows\n", nrows);
+	report("parse", elapsed_s(t0), nrows, log.size());
+
+	// Classify
+	reset_peak_rss();
+	t0 = std::chrono::steady_clock::now();
+	signal_set sigs;
+	for (size_t i = 0; i < nrows; i++) classify_signal(&sigs, &t, i);
+	report("classify", elapsed_s(t0), nrows, log.size());
+
+	// Convert the epochs, collected instead of written
+	reset_peak_rss();
+	t0 = std::chrono::steady_clock::now();
+	std::vector<rnx_epoch> epochs;
+	{
+		rnx_conv conv(NULL);
+		conv.sigs = sigs;
+		conv.collect = &epochs;
+		conv.first = false;
+		conv.allRxMillis_p = t.rx_millis(0);
+		conv.check_clkdiscp = t.hardware_clock_discountinuity_count[0];
+		conv.ref_full_bias_nano = t.full_bias_nano[0];
+		conv.ref_bias_nano = t.bias_nano[0];
+		size_t i0 = 0;
+		for (size_t i = 1; i < nrows; i++) {
+			if (t.rx_millis(i) == conv.allRxMillis_p) continue;
+			conv_rows(&conv, &t, i0, i);
+			start_epoch(&conv, &t, i);
+			i0 = i;
+		}
+		conv_rows(&conv, &t, i0, nrows);
+		close_epoch(&conv, conv.allRxMillis_p);
+	}
+	report("convert", elapsed_s(t0), nrows, log.size());
+
+	// Write the RINEX records to a scratch file
+	reset_peak_rss();
+	t0 = std::chrono::steady_clock::now();
+	FILE* fp = tmpfile();
+	rnx_writer w;
+	char header[RNX_HEADER_MAX];
+	if (!fp || !rnx_writer_open(&w, fp, 0)) {
+		fprintf(stderr, "Cannot create a scratch file\n");
+		return 1;
+	}
+	rnx_writer_header(&w, header, print_rnx_header(header, &sigs));
+	for (size_t k = 0; k < epochs.size(); k++) print_rnx_epoch(&w, &sigs, epochs[k]);
+	bool ok = rnx_writer_close(&w);
+	long out_bytes = ftell(fp);
+	fclose(fp);
+	if (!ok) fprintf(stderr, "Writing the scratch file failed\n");
+	report("write", elapsed_s(t0), nrows, (size_t)out_bytes);
+
+	// Whole conversion from a file
+	fp = fopen(BENCH_LOG, "wb");
+	if (!fp || fwrite(log.data(), 1, log.size(), fp) != log.size()) {
+		fprintf(stderr, "Cannot write " BENCH_LOG "\n");
+		return 1;
+	}
+	fclose(fp);
+	printf("Whole conversion of " BENCH_LOG ":\n");
+
+	reset_peak_rss();
+	t0 = std::chrono::steady_clock::now();
+	ok = convert_file(BENCH_LOG, BENCH_LOG);
+	report("serial", elapsed_s(t0), nrows, log.size());
+
+	reset_peak_rss();
+	{
+		thread_pool pool(nthreads);
+		t0 = std::chrono::steady_clock::now();
+		ok = convert_file_parallel(BENCH_LOG, BENCH_LOG, &pool) && ok;
+		char stage[32];
+		sprintf(stage, "parallel/%d", nthreads);
+		report(stage, elapsed_s(t0), nrows, log.size());
+	}
+
+	remove(BENCH_LOG);
+	if (!epochs.empty()) {
+		char rinex_name[64];
+		sprintf(rinex_name, "bench_stages_log.%02do", (int)epochs[0].time[0] - 2000);
+		remove(rinex_name);
+	}
+	return ok ? 0 : 1;
+}
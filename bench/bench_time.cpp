@@ -0,0 +1,122 @@
+/*
+// Microbenchmark of the GPS time to calendar conversion (gpstime2ymdhms).
+// Compares the former year-by-year / month-by-month walk from 1980 with the
+// closed-form conversion, per call and with the per-day cache, and checks that
+// both give the same dates over 1980-2099 (the range of the former code).
+//
+// Build from this directory together with the converter sources, e.g.
+//   cl /O2 /EHsc /std:c++17 bench_time.cpp ..\rnx_conv.cpp ..\rnx_write.cpp ..\rnx_par.cpp ..\obs_table.cpp ..\obs_cache.cpp ..\conv_stats.cpp ..\obs_kernel.cpp ..\conv_filter.cpp ..\epoch_index.cpp ..\rnx_nav.cpp ..\fix_csv.cpp ..\log_reader.cpp ..\thread_pool.cpp
+//   g++ -O2 -std=c++17 -pthread bench_time.cpp ../rnx_conv.cpp ../rnx_write.cpp ../rnx_par.cpp ../obs_table.cpp ../obs_cache.cpp ../conv_stats.cpp ../obs_kernel.cpp ../conv_filter.cpp ../epoch_index.cpp ../rnx_nav.cpp ../fix_csv.cpp ../log_reader.cpp ../thread_pool.cpp
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+#include "../rnx_conv.h"
+
+#define BENCH_CALLS 10000000            /* Conversions per run */
+#define BENCH_STEP  200000000LL         /* Time between calls (ns): 5 Hz epochs */
+
+// The conversion as it was: walk the years from 1980, then the months
+static void gpstime2ymdhms_walk(long long *time_nano, long long *full_bias_nano, double *bias_nano, double *time)
+{
+	long long   delta_time_nano = *time_nano - *full_bias_nano;
+	long long   delta_time_sec  = delta_time_nano / 1000000000LL;
+	long double delta_time_frac = ((long double)(delta_time_nano - delta_time_sec * 1000000000LL) - (long double)*bias_nano) / 1e9l;
+
+	int HOURSEC = 3600, MINSEC = 60;
+	int DAYSEC = 86400;
+
+	int monthDays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int days = (int)floor((double)(delta_time_sec / DAYSEC)) + 6;
+	int years = 1980;
+
+	int leap = 1;
+	while (days > leap + 365) {
+		days = days - (leap + 365);
+		years = years + 1;
+		leap = ((years%4) == 0);
+	}
+	time[0] = years;
+
+	int month = 1;
+	monthDays[1] = (years % 4) == 0 ? 29 : 28;
+	while (days > monthDays[month - 1]) {
+		days = days - monthDays[month-1];
+		month = month + 1;
+	}
+	time[1] = month;
+	time[2] = days;
+
+	int sinceMidnightSeconds = (int)(delta_time_sec%DAYSEC);
+	time[3] = floor((double)(sinceMidnightSeconds/HOURSEC));
+	int lastHourSeconds = sinceMidnightSeconds%HOURSEC;
+	time[4] = floor((double)(lastHourSeconds/MINSEC));
+	time[5] = (double)((lastHourSeconds%MINSEC)+ delta_time_frac);
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main()
+{
+	long long full_bias_nano = -1300000000000000000LL;  /* Receiver clock in 2021 */
+	double bias_nano = 0.25;
+
+	// Same dates as the former code, every day from 1980-01-06 to 2099-12-31
+	int mismatch = 0;
+	for (long long day = 0; day < 43822; day++) {
+		long long time_nano = day * 86400000000000LL + 45296123456789LL;
+		long long zero = 0;
+		double a[6], b[6];
+		gpstime2ymdhms_walk(&time_nano, &zero, &bias_nano, a);
+		gpstime2ymdhms(&time_nano, &zero, &bias_nano, b);
+		for (int k = 0; k < 6; k++) {
+			if (a[k] != b[k]) {
+				if (mismatch++ < 10) printf("Mismatch on GPS day %lld: %.0f-%.0f-%.0f != %.0f-%.0f-%.0f\n",
+					day, a[0], a[1], a[2], b[0], b[1], b[2]);
+				break;
+			}
+		}
+	}
+	printf("Dates 1980-2099: %s\n", mismatch ? "MISMATCH" : "identical");
+
+	// Epochs of a long session in 2021
+	double time[6], sum = 0;
+	long long time_nano0 = 60000000000LL;
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (long long i = 0; i < BENCH_CALLS; i++) {
+		long long time_nano = time_nano0 + i * BENCH_STEP;
+		gpstime2ymdhms_walk(&time_nano, &full_bias_nano, &bias_nano, time);
+		sum += time[2];
+	}
+	double t_walk = elapsed_ms(t0);
+
+	t0 = std::chrono::steady_clock::now();
+	for (long long i = 0; i < BENCH_CALLS; i++) {
+		long long time_nano = time_nano0 + i * BENCH_STEP;
+		gpstime2ymdhms(&time_nano, &full_bias_nano, &bias_nano, time);
+		sum += time[2];
+	}
+	double t_closed = elapsed_ms(t0);
+
+	gps_day day;
+	t0 = std::chrono::steady_clock::now();
+	for (long long i = 0; i < BENCH_CALLS; i++) {
+		long long time_nano = time_nano0 + i * BENCH_STEP;
+		gpstime2ymdhms(&time_nano, &full_bias_nano, &bias_nano, time, &day);
+		sum += time[2];
+	}
+	double t_cached = elapsed_ms(t0);
+
+	printf("%d conversions (checksum %.0f)\n", BENCH_CALLS, sum);
+	printf("  year/month walk  %8.1f ms  %6.1f ns/call\n", t_walk, t_walk * 1e6 / BENCH_CALLS);
+	printf("  closed form      %8.1f ms  %6.1f ns/call  x%.1f\n", t_closed, t_closed * 1e6 / BENCH_CALLS, t_walk / t_closed);
+	printf("  with day cache   %8.1f ms  %6.1f ns/call  x%.1f\n", t_cached, t_cached * 1e6 / BENCH_CALLS, t_walk / t_cached);
+	return mismatch ? 1 : 0;
+}
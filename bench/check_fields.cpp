@@ -0,0 +1,129 @@
+/*
+// Check of the fixed-width field routines of the RINEX writer (rnx_write.h)
+// against the printf formatting they replace:
+//   observation   fprintf("%14.3lf  "), 16 blanks for no observation
+//   phase + LLI   snprintf(15 bytes, "%13.3lf%1d") then fprintf("%14s"),
+//                 14 blanks for no observation
+//   value         printf("%*.3lf") for the widths used (0, 13, 14)
+// over edge values (zeros, rounding ties of the third decimal, the limits of the
+// integer scaling, fields wider than 14, NaN and infinities) and random values
+// of every magnitude. Prints the mismatches and exits with 1 if there are any.
+//
+// Build from this directory together with the converter sources, e.g.
+//   cl /O2 /EHsc /std:c++17 check_fields.cpp ..\rnx_conv.cpp ..\rnx_write.cpp ..\rnx_par.cpp ..\obs_table.cpp ..\obs_cache.cpp ..\conv_stats.cpp ..\obs_kernel.cpp ..\conv_filter.cpp ..\epoch_index.cpp ..\rnx_nav.cpp ..\fix_csv.cpp ..\log_reader.cpp ..\thread_pool.cpp
+//   g++ -O2 -std=c++17 -pthread check_fields.cpp ../rnx_conv.cpp ../rnx_write.cpp ../rnx_par.cpp ../obs_table.cpp ../obs_cache.cpp ../conv_stats.cpp ../obs_kernel.cpp ../conv_filter.cpp ../epoch_index.cpp ../rnx_nav.cpp ../fix_csv.cpp ../log_reader.cpp ../thread_pool.cpp
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../rnx_write.h"
+
+#define MISMATCH_MAX 20                 /* Mismatches printed; the others are counted */
+
+static unsigned long long checked = 0;
+static unsigned long long mismatches = 0;
+
+static void compare(const char* what, double v, int lli, const char* ref, size_t ref_len, const char* got, size_t got_len)
+{
+	checked++;
+	if (ref_len == got_len && memcmp(ref, got, ref_len) == 0) return;
+	if (++mismatches <= MISMATCH_MAX) {
+		printf("%s %.17g lli %d: \"%.*s\" != \"%.*s\"\n", what, v, lli, (int)got_len, got, (int)ref_len, ref);
+	}
+}
+
+// Observation field as the former writer printed it
+static size_t ref_obs(char* buf, double v)
+{
+	if (v) return sprintf(buf, "%14.3lf  ", v);
+	return sprintf(buf, "                ");
+}
+
+// Phase field with its LLI as the former writer printed it
+static size_t ref_phase(char* buf, double v, int lli)
+{
+	if (!v) return sprintf(buf, "              ");
+	char phase_lli[15];
+	snprintf(phase_lli, sizeof(phase_lli), "%13.3lf%1d", v, lli);
+	return sprintf(buf, "%14s", phase_lli);
+}
+
+static void check_value(double v)
+{
+	char ref[RNX_FIELD_MAX + 16], got[RNX_FIELD_MAX + 16];
+	static const int widths[] = { 0, 13, 14 };
+	for (int w : widths) {
+		size_t n = sprintf(ref, "%*.3lf", w, v);
+		compare("value", v, w, ref, n, got, rnx_put_fixed3(got, v, w) - got);
+	}
+	size_t n = ref_obs(ref, v);
+	compare("obs", v, 0, ref, n, got, rnx_put_obs(got, v) - got);
+	for (int lli = 0; lli < 8; lli++) {
+		n = ref_phase(ref, v, lli);
+		compare("phase", v, lli, ref, n, got, rnx_put_phase(got, v, lli) - got);
+	}
+}
+
+// v and the doubles next to it
+static void add_around(std::vector<double>& values, double v)
+{
+	double lo = v, hi = v;
+	for (int i = 0; i < 4; i++) {
+		lo = nextafter(lo, -HUGE_VAL);
+		hi = nextafter(hi, HUGE_VAL);
+		values.push_back(lo);
+		values.push_back(hi);
+	}
+	values.push_back(v);
+}
+
+int main()
+{
+	std::vector<double> values;
+	values.push_back(0.0);
+	values.push_back(-0.0);
+	values.push_back(std::numeric_limits<double>::quiet_NaN());
+	values.push_back(-std::numeric_limits<double>::quiet_NaN());
+	values.push_back(HUGE_VAL);
+	values.push_back(-HUGE_VAL);
+	values.push_back(std::numeric_limits<double>::denorm_min());
+	values.push_back(std::numeric_limits<double>::max());
+	values.push_back(std::numeric_limits<double>::lowest());
+
+	// Rounding ties of the third decimal and values that round to zero
+	static const double ties[] = { 0.0005, 0.0015, 0.0025, 0.0004999, 0.1235, 1.0005, 2.0015, 123.4565,
+		20000000.0005, 21456789.1235, 999.9995, 99999999.9995, 999999999.9995 };
+	for (double t : ties) {
+		add_around(values, t);
+		add_around(values, -t);
+	}
+
+	// Limits of the integer scaling (1e12 thousandths), of the 13 and 14
+	// character widths (1e9, 1e10), and wider fields
+	static const double limits[] = { 1e9, 1e10, 1e11, 1e12, 1e13, 1e15, 1e20, 1e100, 9999999999.999, 99999999999.999 };
+	for (double t : limits) {
+		add_around(values, t);
+		add_around(values, -t);
+	}
+	for (double v : values) check_value(v);
+
+	// Random values of every magnitude of the observations, and random thousandths
+	std::mt19937_64 rng(20240207);
+	std::uniform_real_distribution<double> mant(-1.0, 1.0);
+	std::uniform_int_distribution<int> expo(-6, 13);
+	std::uniform_int_distribution<long long> milli(-100000000000000LL, 100000000000000LL);
+	for (int i = 0; i < 200000; i++) {
+		check_value(mant(rng) * pow(10.0, expo(rng)));
+		check_value(milli(rng) / 1000.0);
+	}
+
+	printf("%llu fields checked, %llu mismatches\n", checked, mismatches);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Client of the conversion server (csv2rinex -s, see conv_server.cpp), for trying
+the server out and loading it locally.
+
+  conv_client.py -s ADDR convert LOG [-c] [-z] [-o OUT]   send a log, save the output
+  conv_client.py -s ADDR file PATH [-c] [-z] [-o OUT]     have the server read a log
+  conv_client.py -s ADDR stats                           counters and latencies
+  conv_client.py -s ADDR load LOG [-n N] [-p P]          N conversions of LOG, P at a time,
+                                                         retried with back-off while busy
+
+ADDR is unix:PATH or [host:]port as given to the server.
+"""
+
+import argparse
+import socket
+import sys
+import threading
+import time
+
+
+def connect(addr):
+    if addr.startswith("unix:"):
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.connect(addr[5:])
+        return s
+    host, _, port = addr.rpartition(":")
+    return socket.create_connection((host.strip("[]") or "127.0.0.1", int(port)))
+
+
+def read_answer(s, out):
+    """Write the data frames of an answer to out; return its last line"""
+    f = s.makefile("rb")
+    while True:
+        line = f.readline()
+        if not line:
+            return "E connection closed"
+        if line.startswith(b"D "):
+            out.write(f.read(int(line[2:])))
+        else:
+            return line.decode().rstrip("\n")
+
+
+def request(addr, line, payload, out):
+    s = connect(addr)
+    try:
+        try:
+            s.sendall(line.encode() + b"\n")
+        except OSError:
+            return read_answer(s, out)   # Turned away (busy) before the request was read
+        if payload is not None:
+            # Sent from a thread of its own, as the server answers while it reads
+            def send():
+                try:
+                    s.sendall(payload)
+                    s.shutdown(socket.SHUT_WR)
+                except OSError:
+                    pass
+            t = threading.Thread(target=send)
+            t.start()
+            end = read_answer(s, out)
+            t.join()
+            return end
+        return read_answer(s, out)
+    finally:
+        s.close()
+
+
+class Discard:
+    def write(self, data):
+        pass
+
+
+def options(a):
+    return "".join([" -c" if a.c else "", " -z" if a.z else ""])
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Client of csv2rinex -s")
+    ap.add_argument("-s", dest="addr", required=True, help="unix:PATH or [host:]port")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    for name in ("convert", "file"):
+        p = sub.add_parser(name)
+        p.add_argument("log")
+        p.add_argument("-c", action="store_true", help="Compact RINEX")
+        p.add_argument("-z", action="store_true", help="gzip")
+        p.add_argument("-o", dest="out", help="output file (default: standard output)")
+    sub.add_parser("stats")
+    p = sub.add_parser("load")
+    p.add_argument("log")
+    p.add_argument("-n", type=int, default=100, help="conversions (default 100)")
+    p.add_argument("-p", type=int, default=8, help="conversions at a time (default 8)")
+    p.add_argument("-c", action="store_true")
+    p.add_argument("-z", action="store_true")
+    a = ap.parse_args()
+
+    if a.cmd == "stats":
+        end = request(a.addr, "STATS", None, sys.stdout.buffer)
+    elif a.cmd in ("convert", "file"):
+        out = open(a.out, "wb") if a.out else sys.stdout.buffer
+        if a.cmd == "convert":
+            with open(a.log, "rb") as f:
+                end = request(a.addr, "CONVERT" + options(a), f.read(), out)
+        else:
+            end = request(a.addr, "FILE" + options(a) + " " + a.log, None, out)
+        if a.out:
+            out.close()
+    else:
+        with open(a.log, "rb") as f:
+            payload = f.read()
+        latency, ends, lock = [], {}, threading.Lock()
+        left = [a.n]
+
+        def worker():
+            while True:
+                with lock:
+                    if left[0] == 0:
+                        return
+                    left[0] -= 1
+                t0 = time.perf_counter()
+                for retry in range(100):
+                    e = request(a.addr, "CONVERT%s %d" % (options(a), len(payload)), payload, Discard())
+                    if e != "E busy":
+                        break
+                    with lock:
+                        ends["busy, retried"] = ends.get("busy, retried", 0) + 1
+                    time.sleep(0.01 * (retry + 1))   # Back off while the queue is full
+                ms = (time.perf_counter() - t0) * 1e3
+                with lock:
+                    key = "OK" if e.startswith("E OK") else e
+                    ends[key] = ends.get(key, 0) + 1
+                    if key == "OK":
+                        latency.append(ms)
+
+        t0 = time.perf_counter()
+        threads = [threading.Thread(target=worker) for _ in range(a.p)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        sec = time.perf_counter() - t0
+        latency.sort()
+        pct = lambda q: latency[int(q * (len(latency) - 1) + 0.5)] if latency else 0.0
+        print("%d conversions in %.2f s (%.1f/s), %.1f MB/s of log" % (a.n, sec, a.n / sec, a.n * len(payload) / sec / 1e6))
+        print("answers: " + ", ".join("%s %d" % kv for kv in sorted(ends.items())))
+        print("latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f" % (pct(0.5), pct(0.9), pct(0.99), latency[-1] if latency else 0.0))
+        end = "E OK" if ends.get("OK") == a.n else "E some conversions failed"
+
+    if not end.startswith("E OK"):
+        print(end, file=sys.stderr)
+        return 1
+    if a.cmd in ("convert", "file"):
+        print(end, file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
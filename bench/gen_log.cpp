@@ -0,0 +1,86 @@
+/*
+// Write a synthetic GnssLogger log (see log_gen.h), e.g. as test input or to
+// compare the converter's output between releases.
+//
+// Build from this directory:
+//   cl /O2 /EHsc /std:c++17 gen_log.cpp log_gen.cpp
+//   g++ -O2 -std=c++17 gen_log.cpp log_gen.cpp -o gen_log
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+
+#include "log_gen.h"
+
+static void print_usage()
+{
+	printf("usage: gen_log [-d seconds] [-r ms] [-s GREJC] [-1] [-e prob] [-c n] [-g prob] [-S seed] output\n");
+	printf("  -d seconds  length of the log (default 600)\n");
+	printf("  -r ms       epoch interval (default 1000)\n");
+	printf("  -s systems  constellations: G GPS, R GLONASS, E Galileo, C BeiDou, J QZSS (default GREJC)\n");
+	printf("  -1          single frequency only\n");
+	printf("  -e prob     probability of an empty optional field (default 0.3)\n");
+	printf("  -c n        hardware clock discontinuities (default 1)\n");
+	printf("  -g prob     probability per epoch of a Galileo 4 ms jump (default 0.02)\n");
+	printf("  -S seed     random seed (default 1)\n");
+}
+
+int main(int argc, char** argv)
+{
+	gen_opt opt;
+	const char* outfile = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-d") && i + 1 < argc) opt.duration_s = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) opt.rate_ms = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			const char* s = argv[++i];
+			opt.systems = (strchr(s, 'G') ? GEN_GPS : 0) | (strchr(s, 'R') ? GEN_GLO : 0) |
+				(strchr(s, 'E') ? GEN_GAL : 0) | (strchr(s, 'C') ? GEN_BDS : 0) | (strchr(s, 'J') ? GEN_QZS : 0);
+		}
+		else if (!strcmp(argv[i], "-1")) opt.dual_freq = false;
+		else if (!strcmp(argv[i], "-e") && i + 1 < argc) opt.sparse = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc) opt.discontinuities = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-g") && i + 1 < argc) opt.gal_jump = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-S") && i + 1 < argc) opt.seed = strtoull(argv[++i], NULL, 10);
+		else if (argv[i][0] == '-') {
+			print_usage();
+			return 1;
+		}
+		else outfile = argv[i];
+	}
+	if (!outfile) {
+		print_usage();
+		return 1;
+	}
+
+	FILE* fp = fopen(outfile, "wb");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s\n", outfile);
+		return 1;
+	}
+
+	gen_state g;
+	gen_init(&g, &opt);
+	std::string buf;
+	gen_header(&buf);
+	bool ok = true;
+	do {
+		if (buf.size() >= (1 << 20)) {
+			ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+			buf.clear();
+		}
+	} while (ok && gen_epoch(&g, &buf));
+	if (ok) ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+	if (fclose(fp) != 0) ok = false;
+
+	if (!ok) {
+		fprintf(stderr, "Writing %s failed\n", outfile);
+		return 1;
+	}
+	printf("%s: %d epochs\n", outfile, g.epoch);
+	return 0;
+}
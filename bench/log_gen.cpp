@@ -0,0 +1,192 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "log_gen.h"
+
+#define GEN_CLIGHT 299792458.0
+#define GEN_WEEK   604800000000000LL    /* ns */
+#define GEN_DAY    86400000000000LL
+#define GEN_T0     123456789000000LL    /* TimeNanos of the first epoch */
+#define GEN_GPST0  ((2300LL * 604800 + 3 * 86400 + 12 * 3600) * 1000000000LL)  /* GPS time of the first epoch */
+#define GEN_UTC0   1700000000000LL      /* utcTimeMillis of the first epoch */
+
+// splitmix64: the same sequence on every platform, unlike the std distributions
+static unsigned long long gen_next(gen_state* g)
+{
+	unsigned long long z = (g->rng += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static double gen_uniform(gen_state* g, double a, double b)
+{
+	return a + (b - a) * (double)(gen_next(g) >> 11) / 9007199254740992.0;
+}
+
+static bool gen_chance(gen_state* g, double p)
+{
+	return gen_uniform(g, 0.0, 1.0) < p;
+}
+
+static void add_sat(gen_state* g, int cons, int svid, double f1, double f2)
+{
+	gen_sat s;
+	memset(&s, 0, sizeof(s));
+	s.cons = cons;
+	s.svid = svid;
+	s.freq[0] = f1;
+	s.nfreq = 1;
+	if (f2 > 0 && g->opt.dual_freq) {
+		s.freq[1] = f2;
+		s.nfreq = 2;
+	}
+	s.range = gen_uniform(g, 2.0e7, 2.6e7);
+	s.rate = gen_uniform(g, -800.0, 800.0);
+	s.adr[0] = gen_uniform(g, -1e4, 1e4);
+	s.adr[1] = gen_uniform(g, -1e4, 1e4);
+	g->sats.push_back(s);
+}
+
+void gen_init(gen_state* g, const gen_opt* opt)
+{
+	g->opt = *opt;
+	g->sats.clear();
+	g->rng = opt->seed;
+	g->epoch = 0;
+	g->nepoch = opt->rate_ms > 0 ? (int)((long long)opt->duration_s * 1000 / opt->rate_ms) : 0;
+	g->time_nano = GEN_T0;
+	g->full_bias_nano = GEN_T0 - GEN_GPST0 - 1;
+	g->bias_nano = 0.3125;
+	g->disc = 7;
+
+	if (opt->systems & GEN_GPS) for (int p = 1; p <= 12; p++) add_sat(g, 1, p, 1575420030.0, 1176450050.0);
+	if (opt->systems & GEN_GLO) for (int p = 1; p <= 8; p++) add_sat(g, 3, p, 1602000000.0 + (p - 4) * 562500.0, 0);
+	if (opt->systems & GEN_GAL) for (int p = 1; p <= 10; p++) add_sat(g, 6, p, 1575420000.0, 1176450000.0);
+	if (opt->systems & GEN_BDS) for (int p = 1; p <= 8; p++) add_sat(g, 5, p, 1561097980.0, 1176450000.0);
+	if (opt->systems & GEN_QZS) for (int p = 193; p <= 195; p++) add_sat(g, 4, p, 1575420000.0, 1176450000.0);
+}
+
+// Comment lines at the start of a log, as GnssLogger writes them
+void gen_header(std::string* out)
+{
+	*out += "# \n# Header Description:\n# \n"
+		"# Raw,utcTimeMillis,TimeNanos,LeapSecond,TimeUncertaintyNanos,FullBiasNanos,BiasNanos,"
+		"BiasUncertaintyNanos,DriftNanosPerSecond,DriftUncertaintyNanosPerSecond,"
+		"HardwareClockDiscontinuityCount,Svid,TimeOffsetNanos,State,ReceivedSvTimeNanos,"
+		"ReceivedSvTimeUncertaintyNanos,Cn0DbHz,PseudorangeRateMetersPerSecond,"
+		"PseudorangeRateUncertaintyMetersPerSecond,AccumulatedDeltaRangeState,"
+		"AccumulatedDeltaRangeMeters,AccumulatedDeltaRangeUncertaintyMeters,CarrierFrequencyHz,"
+		"CarrierCycles,CarrierPhase,CarrierPhaseUncertainty,MultipathIndicator,SnrInDb,"
+		"ConstellationType,AgcDb\n# \n";
+}
+
+// Optional field: empty with probability opt.sparse
+static void put_optional(gen_state* g, std::string* out, const char* text)
+{
+	*out += ',';
+	if (!gen_chance(g, g->opt.sparse)) *out += text;
+}
+
+// Append the lines of the next epoch; false when the log is complete
+bool gen_epoch(gen_state* g, std::string* out)
+{
+	if (g->epoch >= g->nepoch) return false;
+	int k = g->epoch;
+	const gen_opt* o = &g->opt;
+	long long rate_nano = (long long)o->rate_ms * 1000000;
+
+	// Clock discontinuities spread over the log, and a data gap half way
+	for (int j = 1; j <= o->discontinuities; j++) {
+		if (k == (long long)g->nepoch * j / (o->discontinuities + 1)) {
+			g->disc++;
+			g->full_bias_nano += 2500000;
+			g->bias_nano = gen_uniform(g, -1.0, 1.0);
+		}
+	}
+	if (k == g->nepoch / 2 && k > 0) g->time_nano += 3 * rate_nano;
+
+	char line[512];
+	long long utc = GEN_UTC0 + (g->time_nano - GEN_T0) / 1000000;
+	if (k % 61 == 7) {
+		snprintf(line, sizeof(line), "Fix,gps,51.07%d,-114.13,1100.5,0.1,3.0,%lld\n", k, utc);
+		*out += line;
+		snprintf(line, sizeof(line), "Status,%lld,5,1,12,1575420000,43.5,180.0,30.0,1,1,0\n", utc);
+		*out += line;
+	}
+
+	// Satellites set and rise in 40 epoch windows; some epochs have only 3
+	int nvis = 0;
+	for (size_t i = 0; i < g->sats.size(); i++) {
+		gen_sat* s = &g->sats[i];
+		unsigned long long h = (unsigned long long)(s->cons * 1000 + s->svid) * 0x9e3779b97f4a7c15ULL ^ (unsigned long long)(k / 40) * 0xbf58476d1ce4e5b9ULL;
+		if ((h >> 33) % 5 == 0) continue;
+		if (k % 97 == 50 && nvis >= 3) break;
+		nvis++;
+
+		double range = s->range + s->rate * k * o->rate_ms / 1000.0;
+		if (s->cons == 6) {
+			if (gen_chance(g, o->gal_jump)) s->jump = gen_chance(g, 0.5) ? 4 : -4;
+			else if (s->jump && gen_chance(g, 0.05)) s->jump = 0;
+		}
+
+		for (int f = 0; f < s->nfreq; f++) {
+			double toff = f == 0 ? 0.0 : (gen_chance(g, 0.5) ? 12.5 : 0.0);
+			long long t = g->time_nano + (long long)toff - g->full_bias_nano;
+			double tau = range / GEN_CLIGHT * 1e9 + f * 3.2;
+			long long rx;
+			int state;
+			switch (s->cons) {
+			case 3:  rx = t % GEN_DAY + (3 * 3600 - 18) * 1000000000LL; state = 227; break;
+			case 5:  rx = t % GEN_WEEK - 14 * 1000000000LL; state = 16431; break;
+			case 6:  rx = t % GEN_WEEK; state = 18639; break;
+			default: rx = t % GEN_WEEK; state = 16431; break;
+			}
+			long long send = (long long)llround(rx - tau - g->bias_nano);
+			if (s->cons == 6) send += s->jump * 1000000LL;
+			if (s->cons == 3) send %= GEN_DAY;
+			if (gen_chance(g, 0.03)) state = 1;
+
+			int unc = (int)gen_uniform(g, 5, 41);
+			if (gen_chance(g, 0.02)) unc = 900;
+			double prr = -s->rate + gen_uniform(g, -0.3, 0.3);
+			double prru = gen_chance(g, 0.01) ? 15.0 : gen_uniform(g, 0.02, 0.5);
+			s->adr[f] += s->rate * o->rate_ms / 1000.0;
+			int adrs = gen_chance(g, 0.8) ? 1 : 0;
+			if (gen_chance(g, 0.05)) adrs |= 4;
+			if (gen_chance(g, 0.05)) adrs |= 16;
+			if (gen_chance(g, 0.03)) adrs = 16 | 8 | 1;
+
+			char field[64];
+			snprintf(line, sizeof(line), "Raw,%lld,%lld", utc, g->time_nano);
+			*out += line;
+			put_optional(g, out, "18");
+			*out += ",0.0";
+			snprintf(line, sizeof(line), ",%lld,%.16g", g->full_bias_nano, g->bias_nano);
+			*out += line;
+			snprintf(field, sizeof(field), "%.16g", gen_uniform(g, 5.0, 20.0));
+			put_optional(g, out, field);
+			snprintf(field, sizeof(field), "%.16g", gen_uniform(g, -1.0, 1.0));
+			put_optional(g, out, field);
+			put_optional(g, out, "0.01");
+			snprintf(line, sizeof(line), ",%d,%d,%.16g,%d,%lld,%d,%.6f,%.16g,%.16g,%d,%.16g,",
+				g->disc, s->svid, toff, state, send, unc, gen_uniform(g, 18.0, 48.0), prr, prru,
+				adrs, (adrs & 1) ? s->adr[f] : 0.0);
+			*out += line;
+			if (adrs & 1) *out += "0.002";
+			snprintf(line, sizeof(line), ",%.16g,,,,0,", s->freq[f] + gen_uniform(g, -30.0, 30.0));
+			*out += line;
+			snprintf(line, sizeof(line), ",%d", s->cons);
+			*out += line;
+			snprintf(field, sizeof(field), "%.16g", gen_uniform(g, -2.0, 5.0));
+			put_optional(g, out, field);
+			*out += '\n';
+		}
+	}
+
+	g->time_nano += rate_nano;
+	g->epoch++;
+	return true;
+}
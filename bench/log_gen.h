@@ -0,0 +1,76 @@
+/*
+// Deterministic generator of synthetic GnssLogger logs (Raw lines with the
+// Android 7+ column layout, plus a few Fix/Status lines and comments).
+// Satellite ranges drift linearly, so the logs convert to plausible RINEX.
+// The features that the converter has to handle can be switched on:
+// constellations, dual frequency, empty (",,") optional fields, hardware clock
+// discontinuities, Galileo 4 ms ambiguity jumps, short epochs and data gaps.
+// The same options and seed give the same log on every platform.
+*/
+#ifndef LOG_GEN_H
+#define LOG_GEN_H
+
+#include <string>
+#include <vector>
+
+#define GEN_GPS 0x01                    /* Constellations of gen_opt::systems */
+#define GEN_GLO 0x02
+#define GEN_GAL 0x04
+#define GEN_BDS 0x08
+#define GEN_QZS 0x10
+#define GEN_ALL 0x1f
+
+struct gen_opt
+{
+	int duration_s;          /* Length of the log */
+	int rate_ms;             /* Epoch interval */
+	int systems;             /* GEN_* */
+	bool dual_freq;          /* L5/E5a/B2a next to L1/E1/B1 where the system has it */
+	double sparse;           /* Probability of leaving an optional field empty */
+	int discontinuities;     /* Hardware clock discontinuities, spread over the log */
+	double gal_jump;         /* Probability per epoch of a Galileo 4 ms jump on a satellite */
+	unsigned long long seed;
+
+	gen_opt()
+	{
+		duration_s = 600;
+		rate_ms = 1000;
+		systems = GEN_ALL;
+		dual_freq = true;
+		sparse = 0.3;
+		discontinuities = 1;
+		gal_jump = 0.02;
+		seed = 1;
+	}
+};
+
+struct gen_sat
+{
+	int cons;                /* GnssLogger constellation type */
+	int svid;
+	int nfreq;
+	double freq[2];
+	double range;            /* Range at the first epoch (m) and its rate (m/s) */
+	double rate;
+	double adr[2];
+	int jump;                /* Galileo: current ambiguity jump (ms) */
+};
+
+struct gen_state
+{
+	gen_opt opt;
+	std::vector<gen_sat> sats;
+	unsigned long long rng;
+	int epoch;
+	int nepoch;
+	long long time_nano;     /* Receiver clock TimeNanos */
+	long long full_bias_nano;
+	double bias_nano;
+	int disc;
+};
+
+void gen_init(gen_state* g, const gen_opt* opt);
+void gen_header(std::string* out);
+bool gen_epoch(gen_state* g, std::string* out);
+
+#endif
@@ -0,0 +1,122 @@
+/*
+// Selection of the rows to convert: a GPS time window and a set of systems or
+// signals (-t, -e, -g). A row is judged on its leading clock columns and, for a
+// signal selection, its carrier frequency and constellation type, before the
+// rest of it is parsed; rows left out cost little more than finding their
+// commas, and the log is not read past the end of the window.
+// Rows before the window still bring the reference clock up to date at each
+// hardware clock discontinuity, so the pseudoranges are those of a conversion
+// of the whole log. The Galileo 4 ms check, which follows each satellite from
+// one epoch to the next, starts over at the window as in a log cut there.
+// Decimation (-d) is decided per epoch, when its first row is grouped: an epoch
+// off the grid is not written, and of its rows only the cycle slips and the
+// Galileo pseudoranges are taken (conv_rows), so that the epochs written carry
+// the slips of those left out and the 4 ms check runs as over the whole log.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "rnx_conv.h"
+
+static_assert(SIG_COUNT <= 32, "sig_mask has a bit per signal of sig_table");
+
+// Parse a GPS time "YYYY-MM-DD[ HH:MM[:SS[.sss]]]" (or with T between date and time)
+bool parse_gps_time(const char* str, gnss_time* t)
+{
+	int y = 0, mo = 0, d = 0, h = 0, mi = 0, n = 0;
+	double sec = 0.0;
+	if (sscanf(str, "%d-%d-%d%n", &y, &mo, &d, &n) != 3) return false;
+	const char* p = str + n;
+	if (*p == 'T' || *p == ' ') {
+		int m = 0;
+		if (sscanf(p + 1, "%d:%d%n", &h, &mi, &m) != 2) return false;
+		p += 1 + m;
+		if (*p == ':') {
+			if (sscanf(p + 1, "%lf%n", &sec, &m) != 1) return false;
+			p += 1 + m;
+		}
+	}
+	if (*p != '\0' || mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0.0 || sec >= 61.0) return false;
+
+	*t = ymd2gpsday(y, mo, d) * DAY_NANO + (h * 3600LL + mi * 60LL) * SEC_NANO + (long long)(sec * 1e3 + 0.5) * MILLI_NANO;
+	return true;
+}
+
+// Parse a list of systems and signals such as "G,E" or "G1C,G5Q,E1C": a RINEX
+// system letter selects all its signals, a letter and a signal code one signal
+bool parse_signals(const char* str, unsigned* mask)
+{
+	*mask = 0;
+	const char* p = str;
+	while (*p) {
+		const char* e = strchr(p, ',');
+		if (!e) e = p + strlen(p);
+		size_t len = (size_t)(e - p);
+		unsigned bits = 0;
+		for (int k = 0; k < SIG_COUNT && (len == 1 || len == 3); k++) {
+			if (sys_code[sys_code_function(sig_table[k].sys)] != p[0]) continue;
+			if (len == 3 && memcmp(sig_table[k].code, p + 1, 2) != 0) continue;
+			bits |= 1u << k;
+		}
+		if (!bits) {
+			fprintf(stderr, "Unknown system or signal %.*s\n", (int)len, p);
+			return false;
+		}
+		*mask |= bits;
+		p = *e ? e + 1 : e;
+	}
+	return *mask != 0;
+}
+
+// Keep the receiver clock of a row that is left out before the window as the
+// reference clock, as start_epoch() does for the first row after a discontinuity
+static void take_clock(rnx_conv* conv, const raw_head* h)
+{
+	if (conv->clock_ref && h->hardware_clock_discountinuity_count == conv->check_clkdiscp) return;
+	conv->clock_ref = true;
+	conv->check_clkdiscp = h->hardware_clock_discountinuity_count;
+	conv->ref_full_bias_nano = h->full_bias_nano;
+	conv->ref_bias_nano = h->bias_nano;
+}
+
+// True if the row is to be converted. A row past the end of the window sets
+// conv->done; the rows that follow it are left out unread by the callers.
+bool select_row(rnx_conv* conv, const raw_head* h)
+{
+	gnss_time t = gnss_rx_time(h->time_nano, h->full_bias_nano);
+	if (conv->t_end != 0 && t >= conv->t_end) {
+		conv->done = true;
+		return false;
+	}
+	if (conv->t_start != 0 && t < conv->t_start) {
+		if (conv->first) take_clock(conv, h);
+		conv->stats.skipped++;
+		return false;
+	}
+	if (conv->sig_mask != 0) {
+		int sig = lookup_signal(h->constellation_type, h->carrier_frequency_hz);
+		if (sig < 0 || !(conv->sig_mask >> sig & 1)) {
+			conv->stats.skipped++;
+			return false;
+		}
+	}
+	return true;
+}
+
+// True if the epoch starting at row i of t is to be left out by the decimation:
+// its time is farther than the tolerance from the nearest grid point, or an
+// earlier epoch was already taken for that point
+bool off_grid(rnx_conv* conv, const obs_table* t, size_t i)
+{
+	if (conv->interval_nano == 0) return false;
+	gnss_time time = gnss_rx_time(t->time_nano[i], conv->ref_full_bias_nano);  /* As stamped on the epoch */
+	long long grid = floor_div(time + conv->interval_nano / 2, conv->interval_nano);
+	long long d = time - grid * conv->interval_nano;
+	if (d > conv->interval_tol_nano || d < -conv->interval_tol_nano || grid == conv->grid_last) return true;
+	conv->grid_last = grid;
+	return false;
+}
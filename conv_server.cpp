@@ -0,0 +1,464 @@
+/*
+// Conversion server (-s): a long-running process that converts the logs sent to
+// it over a Unix domain socket or a local TCP port, so that a farm of
+// conversions pays neither process startup nor file setup per log. Each worker
+// keeps a stream converter (conv_stream.cpp) warm from one request to the next.
+//
+// A request is one line, followed by its data:
+//   CONVERT [-c] [-z] [bytes]\n<log>   log text sent on the connection; without a
+//                                       byte count it ends when the client shuts
+//                                       down its side of the connection
+//   FILE [-c] [-z] <path>\n            log read by the server (.txt, .txt.gz, .zip)
+//   STATS\n                            counters, queue depth and latencies (JSON)
+// -c and -z ask for Compact RINEX and gzip as on the command line. The answer is
+// a sequence of frames "D <bytes>\n" followed by that many bytes of output, sent
+// as the epochs are converted, and then a line "E OK <rows> <epochs>\n", or
+// "E <error>\n" if the request failed.
+//
+// Connections wait for a free worker in a queue of bounded length; once it is
+// full, new connections are answered "E busy" at once, so that clients back off
+// instead of piling up. The log of a connection is read only as fast as it is
+// converted and its output taken by the client; a client that stalls for
+// SRV_TIMEOUT_S is dropped. Conversion warnings are counted, not printed.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET srv_socket;
+#define SRV_INVALID    INVALID_SOCKET
+#define srv_close      closesocket
+#define SRV_SEND_FLAGS 0
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int srv_socket;
+#define SRV_INVALID    (-1)
+#define srv_close      close
+#ifdef MSG_NOSIGNAL
+#define SRV_SEND_FLAGS MSG_NOSIGNAL     /* A client that went away is an error, not SIGPIPE */
+#else
+#define SRV_SEND_FLAGS 0
+#endif
+#endif
+
+#include "rnx_conv.h"
+
+#define SRV_LINE_MAX   1024             /* Longest request line */
+#define SRV_RECV_SIZE  (1 << 16)        /* Bytes of a log received at a time */
+#define SRV_LATENCIES  4096             /* Latest conversions kept for the percentiles */
+#define SRV_WAIT_MS    100              /* Longest wait for a connection before checking for a stop */
+#define SRV_TIMEOUT_S  60               /* A client that neither sends nor reads for this long is dropped */
+
+// Result of a request
+#define SRV_DONE   0
+#define SRV_FAILED 1
+#define SRV_INFO   2                    /* STATS: not a conversion */
+
+struct srv_conn
+{
+	srv_socket fd;
+	std::chrono::steady_clock::time_point t_accept;
+};
+
+struct conv_server
+{
+	srv_socket listen_fd;
+	std::string unix_path;   /* Socket file to remove at the end (Unix domain socket) */
+	int nworkers;
+	int queue_max;
+
+	std::mutex lock;         /* Guards everything below */
+	std::condition_variable cv;
+	std::deque<srv_conn> queue;
+	bool stop;
+	int busy;                /* Workers serving a connection */
+	unsigned long long connections, rejected, completed, failed;
+	std::vector<double> latency_ms;  /* Ring of the latest SRV_LATENCIES conversions */
+	size_t nlatency;         /* Conversions timed so far */
+
+	conv_server()
+	{
+		listen_fd = SRV_INVALID;
+		nworkers = queue_max = 0;
+		stop = false;
+		busy = 0;
+		connections = rejected = completed = failed = 0;
+		latency_ms.resize(SRV_LATENCIES);
+		nlatency = 0;
+	}
+};
+
+static std::atomic<bool> srv_stop(false);
+
+// Stop the server (from a signal handler): the connections accepted so far are served
+void server_stop()
+{
+	srv_stop = true;
+}
+
+static bool send_all(srv_socket fd, const char* p, size_t len)
+{
+	while (len > 0) {
+		int n = send(fd, p, (int)std::min(len, (size_t)1 << 30), SRV_SEND_FLAGS);
+		if (n <= 0) return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Output of the stream converter, one data frame per block; user is the socket
+static bool send_frame(void* user, const char* data, size_t len)
+{
+	srv_socket fd = *(srv_socket*)user;
+	char head[32];
+	int n = snprintf(head, sizeof(head), "D %zu\n", len);
+	return send_all(fd, head, n) && send_all(fd, data, len);
+}
+
+// Last line of an answer that failed
+static int send_error(srv_socket fd, const char* msg)
+{
+	std::string line = std::string("E ") + msg + "\n";
+	send_all(fd, line.data(), line.size());
+	return SRV_FAILED;
+}
+
+// Receive the request line; the bytes received after it are the start of the log
+static bool recv_line(srv_socket fd, std::string* line, std::vector<char>* rest)
+{
+	char buf[SRV_LINE_MAX];
+	size_t n = 0;
+	while (n < sizeof(buf)) {
+		int k = recv(fd, buf + n, (int)(sizeof(buf) - n), 0);
+		if (k <= 0) return false;
+		const char* nl = (const char*)memchr(buf + n, '\n', k);
+		n += k;
+		if (nl) {
+			size_t len = nl - buf;
+			if (len > 0 && buf[len - 1] == '\r') len--;
+			line->assign(buf, len);
+			rest->assign(nl + 1, (const char*)buf + n);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Next word of a request line
+static std::string next_word(const char** p)
+{
+	while (**p == ' ' || **p == '\t') (*p)++;
+	const char* s = *p;
+	while (**p && **p != ' ' && **p != '\t') (*p)++;
+	return std::string(s, *p);
+}
+
+// Nearest-rank percentile of sorted values
+static double percentile(const std::vector<double>& v, double q)
+{
+	if (v.empty()) return 0.0;
+	return v[(size_t)(q * (v.size() - 1) + 0.5)];
+}
+
+static std::string server_stats(conv_server* srv)
+{
+	std::lock_guard<std::mutex> lk(srv->lock);
+	size_t n = std::min(srv->nlatency, (size_t)SRV_LATENCIES);
+	std::vector<double> lat(srv->latency_ms.begin(), srv->latency_ms.begin() + n);
+	std::sort(lat.begin(), lat.end());
+
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"workers\": %d, \"busy\": %d, \"queue_depth\": %d, \"queue_max\": %d, "
+		"\"connections\": %llu, \"rejected_busy\": %llu, \"completed\": %llu, \"failed\": %llu, "
+		"\"latency_ms\": {\"samples\": %zu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}\n",
+		srv->nworkers, srv->busy, (int)srv->queue.size(), srv->queue_max,
+		srv->connections, srv->rejected, srv->completed, srv->failed,
+		n, percentile(lat, 0.50), percentile(lat, 0.90), percentile(lat, 0.99), lat.empty() ? 0.0 : lat.back());
+	return buf;
+}
+
+// Serve one connection with the worker's converter (whose output goes to fd)
+static int serve_conn(conv_server* srv, rnx_conv* conv, srv_socket fd, std::vector<char>* buf)
+{
+	std::string line;
+	std::vector<char> rest;
+	if (!recv_line(fd, &line, &rest)) return send_error(fd, "no request line");
+
+	const char* p = line.c_str();
+	std::string cmd = next_word(&p);
+	if (cmd == "STATS") {
+		std::string json = server_stats(srv);
+		send_frame(&fd, json.data(), json.size());
+		send_all(fd, "E OK\n", 5);
+		return SRV_INFO;
+	}
+	if (cmd != "CONVERT" && cmd != "FILE") return send_error(fd, "unknown request");
+
+	int format = 0;
+	for (;;) {
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p != '-') break;
+		std::string opt = next_word(&p);
+		if (opt == "-c") format |= RNX_FMT_CRX;
+		else if (opt == "-z") format |= RNX_FMT_GZ;
+		else return send_error(fd, "unknown option");
+	}
+	if ((format & RNX_FMT_GZ) && !rnx_gzip_supported()) return send_error(fd, "gzip output needs a build with zlib (HAVE_ZLIB)");
+	conv->format = format;
+
+	if (cmd == "FILE") {
+		if (!*p) return send_error(fd, "no file");
+		log_reader rd;
+		if (!log_open(&rd, p)) return send_error(fd, "cannot open the log");
+		const char* l = NULL;
+		size_t len = 0;
+		while (!conv->failed && log_next_line(&rd, &l, &len)) {
+			if (len >= 4 && memcmp(l, "Raw,", 4) == 0) conv_line(conv, l, len);
+		}
+		bool read_failed = rd.failed;
+		log_close(&rd);
+		if (read_failed) return send_error(fd, "the log could not be read to its end");
+	}
+	else {
+		// The log is received as it is converted, so a fast sender waits for the converter
+		long long limit = -1;
+		if (*p) {
+			char* end = NULL;
+			limit = strtoll(p, &end, 10);
+			if (limit < 0 || *end) return send_error(fd, "bad byte count");
+		}
+		long long got = (long long)rest.size();
+		if (limit >= 0 && got > limit) got = limit;
+		if (got > 0) conv_push(conv, rest.data(), (size_t)got);
+		while (!conv->failed && (limit < 0 || got < limit)) {
+			int want = (int)buf->size();
+			if (limit >= 0 && limit - got < want) want = (int)(limit - got);
+			int k = recv(fd, buf->data(), want, 0);
+			if (k < 0 || (k == 0 && limit >= 0)) return send_error(fd, "the log ends early");
+			if (k == 0) break;
+			conv_push(conv, buf->data(), k);
+			got += k;
+		}
+	}
+
+	conv_stats stats;
+	bool ok = conv_end(conv, &stats);
+	if (!ok) return send_error(fd, stats.rows ? "conversion failed" : "no observations converted");
+
+	char end[64];
+	int n = snprintf(end, sizeof(end), "E OK %llu %llu\n", stats.rows, stats.epochs);
+	return send_all(fd, end, n) ? SRV_DONE : SRV_FAILED;
+}
+
+// Worker: serve queued connections until the server stops and the queue is empty
+static void server_worker(conv_server* srv)
+{
+	srv_socket fd = SRV_INVALID;
+	rnx_conv* conv = conv_open_stream(send_frame, &fd);
+	conv->quiet = true;
+	std::vector<char> buf(SRV_RECV_SIZE);
+
+	for (;;) {
+		srv_conn c;
+		{
+			std::unique_lock<std::mutex> lk(srv->lock);
+			srv->cv.wait(lk, [srv] { return srv->stop || !srv->queue.empty(); });
+			if (srv->queue.empty()) break;
+			c = srv->queue.front();
+			srv->queue.pop_front();
+			srv->busy++;
+		}
+
+		fd = c.fd;
+		int r = serve_conn(srv, conv, fd, &buf);
+		conv_reset(conv);
+		srv_close(fd);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - c.t_accept).count();
+
+		std::lock_guard<std::mutex> lk(srv->lock);
+		srv->busy--;
+		if (r == SRV_INFO) continue;
+		if (r == SRV_DONE) srv->completed++;
+		else srv->failed++;
+		srv->latency_ms[srv->nlatency++ % SRV_LATENCIES] = ms;
+	}
+	conv_close_stream(conv);
+}
+
+// Listen on unix:<path> or [host:]port (host 127.0.0.1 by default)
+static bool server_listen(conv_server* srv, const char* addr)
+{
+	srv_socket fd = SRV_INVALID;
+	if (!strncmp(addr, "unix:", 5)) {
+#ifdef _WIN32
+		fprintf(stderr, "Unix domain sockets are not supported on this system\n");
+		return false;
+#else
+		const char* path = addr + 5;
+		sockaddr_un sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sun_family = AF_UNIX;
+		if (!*path || strlen(path) >= sizeof(sa.sun_path)) {
+			fprintf(stderr, "Bad socket path %s\n", path);
+			return false;
+		}
+		strcpy(sa.sun_path, path);
+
+		// A socket left by a server that did not end cleanly; anything else is kept
+		struct stat st;
+		if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == SRV_INVALID || bind(fd, (sockaddr*)&sa, sizeof(sa)) != 0 || listen(fd, SOMAXCONN) != 0) {
+			fprintf(stderr, "Cannot listen on %s\n", path);
+			if (fd != SRV_INVALID) srv_close(fd);
+			return false;
+		}
+		srv->unix_path = path;
+#endif
+	}
+	else {
+		std::string host = "127.0.0.1";
+		const char* port = addr;
+		const char* colon = strrchr(addr, ':');
+		if (colon) {
+			host.assign(addr, colon);
+			port = colon + 1;
+			if (host.size() >= 2 && host[0] == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+		}
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		addrinfo* res = NULL;
+		if (getaddrinfo(host.c_str(), port, &hints, &res) != 0 || !res) {
+			fprintf(stderr, "Bad address %s\n", addr);
+			return false;
+		}
+		fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		int on = 1;
+		if (fd != SRV_INVALID) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+		bool ok = fd != SRV_INVALID && bind(fd, res->ai_addr, (int)res->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+		freeaddrinfo(res);
+		if (!ok) {
+			fprintf(stderr, "Cannot listen on %s\n", addr);
+			if (fd != SRV_INVALID) srv_close(fd);
+			return false;
+		}
+	}
+	srv->listen_fd = fd;
+	return true;
+}
+
+// Time out the reads and writes of a connection, so that a stalled client does
+// not hold a worker forever
+static void set_timeouts(srv_socket fd)
+{
+#ifdef _WIN32
+	DWORD ms = SRV_TIMEOUT_S * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&ms, sizeof(ms));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&ms, sizeof(ms));
+#else
+	timeval tv;
+	tv.tv_sec = SRV_TIMEOUT_S;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+// Wait up to SRV_WAIT_MS for a connection
+static bool wait_connection(srv_socket fd)
+{
+	fd_set set;
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+	timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = SRV_WAIT_MS * 1000;
+	return select((int)fd + 1, &set, NULL, NULL, &tv) > 0;
+}
+
+// Run the server until server_stop(); nthreads workers, at most queue_max
+// connections waiting for one
+bool run_server(const char* addr, int nthreads, int queue_max)
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+		fprintf(stderr, "Cannot start Winsock\n");
+		return false;
+	}
+#endif
+	conv_server srv;
+	srv.nworkers = nthreads > 0 ? nthreads : 1;
+	srv.queue_max = queue_max > 0 ? queue_max : 4 * srv.nworkers;
+	if (!server_listen(&srv, addr)) return false;
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < srv.nworkers; i++) workers.push_back(std::thread(server_worker, &srv));
+	printf("Listening on %s: %d workers, queue of %d\n", addr, srv.nworkers, srv.queue_max);
+	fflush(stdout);
+
+	while (!srv_stop) {
+		if (!wait_connection(srv.listen_fd)) continue;
+		srv_socket fd = accept(srv.listen_fd, NULL, NULL);
+		if (fd == SRV_INVALID) continue;
+		set_timeouts(fd);
+
+		std::unique_lock<std::mutex> lk(srv.lock);
+		srv.connections++;
+		if ((int)srv.queue.size() >= srv.queue_max) {
+			srv.rejected++;
+			lk.unlock();
+			send_error(fd, "busy");
+			srv_close(fd);
+			continue;
+		}
+		srv_conn c;
+		c.fd = fd;
+		c.t_accept = std::chrono::steady_clock::now();
+		srv.queue.push_back(c);
+		lk.unlock();
+		srv.cv.notify_one();
+	}
+
+	// Serve the connections accepted so far, then stop the workers
+	srv_close(srv.listen_fd);
+	{
+		std::lock_guard<std::mutex> lk(srv.lock);
+		srv.stop = true;
+	}
+	srv.cv.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+#ifndef _WIN32
+	if (!srv.unix_path.empty()) unlink(srv.unix_path.c_str());
+#else
+	WSACleanup();
+#endif
+	printf("Server stopped: %s", server_stats(&srv).c_str());
+	return true;
+}
@@ -0,0 +1,141 @@
+/*
+// Conversion metrics: counters of the rows read, dropped and converted, stage
+// timers, the waits of the pipeline stages (-P) for one another, the records of
+// the products (-n, -p), and their export as JSON (-m), so that the logs of a batch and the
+// performance of the converter can be compared between runs.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include "rnx_conv.h"
+
+static const char* rej_name[NREJ] = { "signal", "state", "uncertainty", "range", "glonass_slot" };
+static const char* stat_sys_name[STAT_SYS] = { "G", "R", "E", "C", "J", "I", "other" };
+
+// Hand the statistics of a finished conversion to the caller. Parsing (or
+// copying cached rows) is the part of the total that the other stages leave.
+void take_stats(rnx_conv* conv, double t_total, conv_stats* stats)
+{
+	if (!stats) return;
+	conv_stats* s = &conv->stats;
+	s->t_total = t_total;
+	s->t_parse = t_total - s->t_convert - s->t_write;
+	if (s->t_parse < 0.0) s->t_parse = 0.0;
+	s->sigs = conv->sigs;
+	*stats = *s;
+}
+
+// Add the counters and timers of s to sum; the signals of s are merged into those of sum
+void add_stats(conv_stats* sum, const conv_stats* s)
+{
+	sum->rows += s->rows;
+	sum->skipped += s->skipped;
+	sum->epochs += s->epochs;
+	for (int k = 0; k < STAT_SYS; k++) {
+		sum->rows_sys[k] += s->rows_sys[k];
+		for (int r = 0; r < NREJ; r++) sum->rejected[r][k] += s->rejected[r][k];
+	}
+	for (int w = 0; w < NWARN; w++) sum->warnings[w] += s->warnings[w];
+	for (int k = 0; k < NSTALL; k++) sum->stalls[k] += s->stalls[k];
+	sum->nav_records += s->nav_records;
+	sum->ephemerides += s->ephemerides;
+	sum->fixes += s->fixes;
+
+	for (int k = 0; k < STAT_SYS; k++) {
+		for (int f = 0; f < MAX_FRQ; f++) {
+			if (!s->obs[k][f] || f >= s->sigs.nsignals[k]) continue;
+			sum->obs[k][add_signal(&sum->sigs, s->sigs.sig[k][f])] += s->obs[k][f];
+		}
+	}
+
+	sum->t_parse += s->t_parse;
+	sum->t_convert += s->t_convert;
+	sum->t_write += s->t_write;
+	sum->t_total += s->t_total;
+}
+
+// String with the characters that JSON reserves escaped
+static void put_json_string(FILE* fp, const char* str)
+{
+	fputc('"', fp);
+	for (const char* p = str; *p; p++) {
+		if (*p == '"' || *p == '\\') fprintf(fp, "\\%c", *p);
+		else if ((unsigned char)*p < 0x20) fprintf(fp, "\\u%04x", *p);
+		else fputc(*p, fp);
+	}
+	fputc('"', fp);
+}
+
+static void put_sys_counts(FILE* fp, const unsigned long long* n)
+{
+	fputc('{', fp);
+	for (int k = 0; k < STAT_SYS; k++) fprintf(fp, "%s\"%s\": %llu", k ? ", " : "", stat_sys_name[k], n[k]);
+	fputc('}', fp);
+}
+
+static void put_stats(FILE* fp, const conv_stats* s, const char* indent)
+{
+	fprintf(fp, "%s\"rows\": %llu,\n", indent, s->rows);
+	fprintf(fp, "%s\"rows_skipped\": %llu,\n", indent, s->skipped);
+	fprintf(fp, "%s\"epochs\": %llu,\n", indent, s->epochs);
+	fprintf(fp, "%s\"rows_by_system\": ", indent);
+	put_sys_counts(fp, s->rows_sys);
+
+	fprintf(fp, ",\n%s\"rejected\": {\n", indent);
+	for (int r = 0; r < NREJ; r++) {
+		fprintf(fp, "%s  \"%s\": ", indent, rej_name[r]);
+		put_sys_counts(fp, s->rejected[r]);
+		fprintf(fp, "%s\n", r < NREJ - 1 ? "," : "");
+	}
+
+	fprintf(fp, "%s},\n%s\"observations\": {", indent, indent);
+	bool first = true;
+	for (int k = 0; k < STAT_SYS - 1; k++) {
+		for (int f = 0; f < s->sigs.nsignals[k]; f++) {
+			fprintf(fp, "%s\"%c L%s\": %llu", first ? "" : ", ", sys_code[k], sig_table[s->sigs.sig[k][f]].code, s->obs[k][f]);
+			first = false;
+		}
+	}
+
+	fprintf(fp, "},\n%s\"warnings\": {\"sparse_epochs\": %llu, \"week_rollover\": %llu},\n", indent,
+		s->warnings[WARN_SPARSE], s->warnings[WARN_ROLLOVER]);
+	fprintf(fp, "%s\"pipeline_stalls\": {\"read\": %llu, \"convert_input\": %llu, \"convert_output\": %llu, \"write\": %llu},\n", indent,
+		s->stalls[STALL_READ], s->stalls[STALL_PARSE], s->stalls[STALL_OUTPUT], s->stalls[STALL_WRITE]);
+	fprintf(fp, "%s\"products\": {\"nav_records\": %llu, \"ephemerides\": %llu, \"fixes\": %llu},\n", indent,
+		s->nav_records, s->ephemerides, s->fixes);
+	fprintf(fp, "%s\"time_ms\": {\"parse\": %.3f, \"convert\": %.3f, \"write\": %.3f, \"total\": %.3f},\n", indent,
+		s->t_parse * 1e3, s->t_convert * 1e3, s->t_write * 1e3, s->t_total * 1e3);
+	fprintf(fp, "%s\"rows_per_s\": %.0f\n", indent, s->t_total > 0.0 ? s->rows / s->t_total : 0.0);
+}
+
+// Write the statistics of each input and their totals as a JSON document
+bool write_metrics(const char* file, const std::vector<const char*>& inputs, const std::vector<conv_stats>& stats)
+{
+	FILE* fp = fopen(file, "w");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s\n", file);
+		return false;
+	}
+
+	conv_stats total;
+	fprintf(fp, "{\n  \"files\": [\n");
+	for (size_t i = 0; i < stats.size(); i++) {
+		fprintf(fp, "    {\n      \"input\": ");
+		put_json_string(fp, inputs[i]);
+		fprintf(fp, ",\n");
+		put_stats(fp, &stats[i], "      ");
+		fprintf(fp, "    }%s\n", i + 1 < stats.size() ? "," : "");
+		add_stats(&total, &stats[i]);
+	}
+	fprintf(fp, "  ],\n  \"total\": {\n");
+	put_stats(fp, &total, "    ");
+	fprintf(fp, "  }\n}\n");
+
+	bool ok = !ferror(fp);
+	if (fclose(fp) != 0) ok = false;
+	if (!ok) fprintf(stderr, "Writing %s failed\n", file);
+	return ok;
+}
@@ -0,0 +1,126 @@
+/*
+// Stream conversion, for embedding the converter in a long-running process.
+// The caller pushes the text of a log in buffers of any size (or line by line)
+// and receives the RINEX output through a callback, without files:
+//
+//   rnx_conv* conv = conv_open_stream(out, user, &opt);
+//   while (...) conv_push(conv, data, len);
+//   conv_end(conv, &stats);          // last epoch, end of the output
+//   conv_reset(conv);                // same instance for the next log
+//   ...
+//   conv_close_stream(conv);
+//
+// The output of a stream cannot be rewound to update its header, so the header
+// lists every signal that the converter knows from the first epoch on, the way
+// Compact RINEX does. The records of the epochs completed by a push are handed
+// to the callback before conv_push() returns (in gzip format, as far as the
+// deflate stream has produced them).
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include "rnx_conv.h"
+
+rnx_conv* conv_open_stream(rnx_out_fn out, void* user, const conv_opt* opt)
+{
+	rnx_conv* conv = new rnx_conv(NULL, opt);
+	conv->out_fn = out;
+	conv->out_user = user;
+	add_known_signals(&conv->sigs);
+	return conv;
+}
+
+// Take one line of a log; lines other than Raw records are skipped
+static void push_line(rnx_conv* conv, const char* line, size_t len)
+{
+	if (len > 0 && line[len - 1] == '\r') len--;
+	if (len < 4 || memcmp(line, "Raw,", 4) != 0) return;
+	conv_line(conv, line, len);
+}
+
+// Push the next part of a log. A line may be split across pushes; its start is
+// kept until the rest arrives. False once the conversion or the output failed.
+bool conv_push(rnx_conv* conv, const char* data, size_t len)
+{
+	const char* end = data + len;
+	const char* p = data;
+	while (p < end && !conv->failed) {
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		if (!nl) {
+			conv->partial.insert(conv->partial.end(), p, end);
+			break;
+		}
+		if (!conv->partial.empty()) {
+			conv->partial.insert(conv->partial.end(), p, nl);
+			push_line(conv, conv->partial.data(), conv->partial.size());
+			conv->partial.clear();
+		}
+		else push_line(conv, p, nl - p);
+		p = nl + 1;
+	}
+	if (conv->out.buf && !rnx_writer_flush(&conv->out)) conv->failed = true;
+	return !conv->failed;
+}
+
+// Push one complete line, without its line break
+bool conv_push_line(rnx_conv* conv, const char* line, size_t len)
+{
+	if (!conv->failed) push_line(conv, line, len);
+	if (conv->out.buf && !rnx_writer_flush(&conv->out)) conv->failed = true;
+	return !conv->failed;
+}
+
+// End of the log: convert an unterminated last line, write the last epoch and
+// end the output. False if nothing was converted or the output failed.
+bool conv_end(rnx_conv* conv, conv_stats* stats)
+{
+	if (!conv->partial.empty() && !conv->failed) {
+		push_line(conv, conv->partial.data(), conv->partial.size());
+	}
+	conv->partial.clear();
+	bool ok = conv_finish(conv);
+
+	// The stream is paced by the caller, so only the stages it runs are timed
+	take_stats(conv, conv->stats.t_convert + conv->stats.t_write, stats);
+	return ok;
+}
+
+// Make a stream ready for the next log; the output of a log that was not ended
+// is dropped. The output callback, the options and the memory of the row and
+// satellite tables are kept.
+void conv_reset(rnx_conv* conv)
+{
+	if (conv->out.buf) {
+		conv->out.failed = true;         /* Release the writer without handing over what it holds */
+		rnx_writer_close(&conv->out);
+	}
+	conv->partial.clear();
+	conv->rows.clear();
+	conv->sigs = signal_set();
+	add_known_signals(&conv->sigs);
+	conv->failed = false;
+	conv->first = true;
+	conv->clock_ref = false;
+	conv->done = false;
+	conv->grid_last = -1;
+	conv->skip = false;
+	conv->allRxMillis_p = 0;
+	conv->check_clkdiscp = 0;
+	conv->ref_full_bias_nano = 0;
+	conv->ref_bias_nano = 0.0;
+	conv->day = gps_day();
+	clear_rnx_epoch(&conv->repoch);
+	conv->nepoch = 0;
+	for (size_t i = 0; i < conv->sat_tab.size(); i++) conv->sat_tab[i] = sat_state();
+	conv->stats = conv_stats();
+	memset(conv->warned, 0, sizeof(conv->warned));
+}
+
+void conv_close_stream(rnx_conv* conv)
+{
+	if (conv->out.buf) rnx_writer_close(&conv->out);
+	delete conv;
+}
@@ -0,0 +1,154 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "rnx_conv.h"
+#include "epoch_index.h"
+
+std::string obi_path(const char* log)
+{
+	return std::string(log) + ".obi";
+}
+
+// Size and modification time of the log, which an index must match
+static bool log_stat(const char* log, unsigned long long* size, long long* mtime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(log, &st) != 0) return false;
+#else
+	struct stat st;
+	if (stat(log, &st) != 0) return false;
+#endif
+	*size = (unsigned long long)st.st_size;
+	*mtime = (long long)st.st_mtime;
+	return true;
+}
+
+// Scan a text log for its epochs, reading only the clock columns of the Raw
+// rows. Epochs and reference clocks are found as conv_row() and start_epoch()
+// find them: a new epoch at each change of the millisecond of GPS time, a new
+// reference at the first epoch and after each clock discontinuity.
+bool obi_build(const char* log, epoch_index* ix)
+{
+	ix->entries.clear();
+	log_reader rd;
+	if (!log_open(&rd, log)) return false;
+	if (rd.z || (rd.mapped && obc_is_cache(rd.data, rd.size))) {
+		log_close(&rd);
+		fprintf(stderr, "%s is compressed or a cache file; only text logs are indexed\n", log);
+		return false;
+	}
+
+	obi_entry e;
+	memset(&e, 0, sizeof(e));
+	long long millis_p = 0;
+	const char* line = NULL;
+	size_t len = 0;
+	while (log_next_line(&rd, &line, &len)) {
+		if (len < 4 || memcmp(line, "Raw,", 4) != 0) continue;
+		raw_head h;
+		if (!read_raw_head(line, line + len, &h, false)) continue;
+
+		long long millis = rx_millis(h.time_nano, h.full_bias_nano);
+		if (!ix->entries.empty() && millis == millis_p) continue;
+		if (ix->entries.empty() || h.hardware_clock_discountinuity_count != e.disc) {
+			e.ref_full_bias_nano = h.full_bias_nano;
+			e.ref_bias_nano = h.bias_nano;
+			e.disc = h.hardware_clock_discountinuity_count;
+		}
+		e.offset = log_offset(&rd, line);
+		e.time = gnss_rx_time(h.time_nano, h.full_bias_nano);
+		ix->entries.push_back(e);
+		millis_p = millis;
+	}
+	bool ok = !rd.failed;
+	log_close(&rd);
+	return ok;
+}
+
+// Write the index next to the log
+bool obi_save(const char* log, const epoch_index* ix)
+{
+	obi_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, OBI_MAGIC, 8);
+	h.version = OBI_VERSION;
+	h.endian = OBI_ENDIAN;
+	h.nepochs = ix->entries.size();
+	if (!log_stat(log, &h.log_size, &h.log_mtime)) return false;
+
+	std::string path = obi_path(log);
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		fprintf(stderr, "Cannot create the index file %s\n", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+	if (ok && h.nepochs) ok = fwrite(ix->entries.data(), sizeof(obi_entry), ix->entries.size(), fp) == ix->entries.size();
+	if (fclose(fp) != 0) ok = false;
+	if (!ok) {
+		remove(path.c_str());
+		fprintf(stderr, "Writing the index file %s failed\n", path.c_str());
+	}
+	return ok;
+}
+
+// Read the index of a log; false if there is none or it does not match the log
+bool obi_load(const char* log, epoch_index* ix)
+{
+	ix->entries.clear();
+	unsigned long long size;
+	long long mtime;
+	if (!log_stat(log, &size, &mtime)) return false;
+
+	FILE* fp = fopen(obi_path(log).c_str(), "rb");
+	if (!fp) return false;
+	obi_header h;
+	bool ok = fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, OBI_MAGIC, 8) == 0 &&
+		h.version == OBI_VERSION && h.endian == OBI_ENDIAN && h.log_size == size && h.log_mtime == mtime;
+	if (ok) {
+		ix->entries.resize((size_t)h.nepochs);
+		if (h.nepochs) ok = fread(ix->entries.data(), sizeof(obi_entry), ix->entries.size(), fp) == ix->entries.size();
+	}
+	fclose(fp);
+	if (!ok) ix->entries.clear();
+	return ok;
+}
+
+// Load the index of a log; if it is missing or stale and build is set, scan
+// the log and save a new one
+bool obi_open(const char* log, epoch_index* ix, bool build)
+{
+	if (obi_load(log, ix)) return true;
+	if (!build || !obi_build(log, ix)) return false;
+	obi_save(log, ix);
+	return true;
+}
+
+// First epoch at or after GPS time t (entries.size() if none)
+size_t obi_find_time(const epoch_index* ix, gnss_time t)
+{
+	size_t lo = 0, hi = ix->entries.size();
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ix->entries[mid].time < t) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// First epoch starting at or after a file offset (entries.size() if none)
+size_t obi_find_offset(const epoch_index* ix, unsigned long long offset)
+{
+	size_t lo = 0, hi = ix->entries.size();
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ix->entries[mid].offset < offset) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
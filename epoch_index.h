@@ -0,0 +1,63 @@
+/*
+// Sidecar index of the epochs of a GnssLogger log (.obi, next to the log).
+// Each entry holds the byte offset of the first Raw row of an epoch, its GPS
+// time, its hardware clock discontinuity count and the reference clock in
+// effect for it (full and sub-ns bias of the first epoch after the last
+// discontinuity). With it a conversion starts at any epoch without reading what
+// comes before: at the start of a time window (-t), or at the exact epoch
+// boundaries where the parallel path cuts its chunks. The index is built by a
+// scan that reads only the clock columns of each row.
+//
+// Layout (native byte order):
+//   obi_header
+//   nepochs x obi_entry, in file order
+// The header records the size and modification time of the log; an index that
+// does not match them is stale and not used.
+*/
+#ifndef EPOCH_INDEX_H
+#define EPOCH_INDEX_H
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+
+#include "gnss_time.h"
+
+#define OBI_MAGIC      "CSV2RNXI"       /* First 8 bytes of an index file */
+#define OBI_VERSION    1
+#define OBI_ENDIAN     0x01020304
+
+struct obi_header
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int endian;
+	unsigned long long log_size;     /* Size and modification time of the log indexed */
+	long long log_mtime;
+	unsigned long long nepochs;
+};
+
+struct obi_entry
+{
+	unsigned long long offset;       /* File offset of the first Raw row of the epoch */
+	gnss_time time;                  /* Receiver clock of that row in GPS time (BiasNanos excluded) */
+	long long ref_full_bias_nano;    /* Reference clock of the epoch */
+	double    ref_bias_nano;
+	int disc;                        /* HardwareClockDiscontinuityCount */
+	int reserved;
+};
+
+struct epoch_index
+{
+	std::vector<obi_entry> entries;
+};
+
+std::string obi_path(const char* log);
+bool obi_build(const char* log, epoch_index* ix);
+bool obi_save(const char* log, const epoch_index* ix);
+bool obi_load(const char* log, epoch_index* ix);
+bool obi_open(const char* log, epoch_index* ix, bool build);
+size_t obi_find_time(const epoch_index* ix, gnss_time t);
+size_t obi_find_offset(const epoch_index* ix, unsigned long long offset);
+
+#endif
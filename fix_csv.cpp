@@ -0,0 +1,139 @@
+/*
+// CSV file of the positions of the Fix records of a log (products.h). The columns
+// are found by name in the "# Fix," line of the log header, as GnssLogger
+// versions order them differently; a log without one is read with the layout of
+// the first versions:
+//   Fix,Provider,Latitude,Longitude,Altitude,Speed,Accuracy,(UTC)TimeInMs
+// The fields are copied as they are, in a fixed order with the time first.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+#include "rnx_conv.h"
+#include "products.h"
+
+#define FIX_HEADER "UnixTimeMillis,Provider,LatitudeDegrees,LongitudeDegrees,AltitudeMeters,SpeedMps,AccuracyMeters,BearingDegrees,VerticalAccuracyMeters\n"
+
+// Name prefixes of the fields in the "# Fix," line, in the order of FIX_*
+static const char* const fix_names[FIX_NCOL][2] = {
+	{ "UnixTimeMillis", "(UTC)TimeInMs" },
+	{ "Provider", NULL },
+	{ "Latitude", NULL },
+	{ "Longitude", NULL },
+	{ "Altitude", NULL },
+	{ "Speed", NULL },
+	{ "Accuracy", NULL },
+	{ "Bearing", NULL },
+	{ "VerticalAccuracy", NULL },
+};
+
+fix_conv::fix_conv(const char* input, const char* file, int fmt)
+{
+	static const int v1[FIX_NCOL] = { 6, 0, 1, 2, 3, 4, 5, -1, -1 };
+	log = input;
+	outfile = file;
+	format = fmt;
+	memcpy(col, v1, sizeof(col));
+	fp = NULL;
+	memset(&out, 0, sizeof(out));
+	failed = false;
+	fixes = 0;
+}
+
+static bool has_prefix(const std::string& s, const char* prefix)
+{
+	return prefix && s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Columns of the Fix records, from the "# Fix," line of the log header. The
+// first column of a name is taken: "SpeedMps" before "SpeedAccuracyMps".
+void fix_columns(fix_conv* fix, const char* line, size_t len)
+{
+	for (int f = 0; f < FIX_NCOL; f++) fix->col[f] = -1;
+	const char* end = line + len;
+	const char* p = (const char*)memchr(line, ',', len);
+	for (int k = 0; p; k++) {
+		const char* token = p + 1;
+		p = (const char*)memchr(token, ',', end - token);
+		std::string name(token, p ? p : end);
+		while (!name.empty() && (name.back() == '\r' || name.back() == ' ')) name.pop_back();
+		for (int f = 0; f < FIX_NCOL; f++) {
+			if (fix->col[f] >= 0) continue;
+			if (has_prefix(name, fix_names[f][0]) || has_prefix(name, fix_names[f][1])) {
+				fix->col[f] = k;
+				break;
+			}
+		}
+	}
+}
+
+// Create the file at the first record
+static bool open_fix_file(fix_conv* fix)
+{
+	bool gz = (fix->format & RNX_FMT_GZ) != 0;
+	std::string name = output_name(fix->outfile, gz ? ".fix.csv.gz" : ".fix.csv");
+	fix->fp = fopen(name.c_str(), gz ? "wb" : "w");
+	if (!fix->fp) {
+		fprintf(stderr, "Cannot create %s\n", name.c_str());
+		return false;
+	}
+	if (!rnx_writer_open(&fix->out, fix->fp, fix->format & RNX_FMT_GZ) ||
+		!rnx_writer_text(&fix->out, FIX_HEADER, sizeof(FIX_HEADER) - 1)) {
+		fprintf(stderr, "Writing %s failed\n", name.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Write one Fix record
+void fix_line(fix_conv* fix, const char* line, size_t len)
+{
+	if (fix->failed) return;
+	if (!fix->fp && !open_fix_file(fix)) {
+		fix->failed = true;
+		return;
+	}
+	while (len > 0 && line[len - 1] == '\r') len--;
+	const char* end = line + len;
+	const char* field[64];
+	size_t field_len[64];
+	int n = 0;
+	const char* p = (const char*)memchr(line, ',', len);  /* Skip the "Fix" tag */
+	while (p && n < 64) {
+		const char* token = p + 1;
+		p = (const char*)memchr(token, ',', end - token);
+		field[n] = token;
+		field_len[n++] = (size_t)((p ? p : end) - token);
+	}
+
+	char buf[1024];
+	size_t m = 0;
+	for (int f = 0; f < FIX_NCOL; f++) {
+		int k = fix->col[f];
+		if (f > 0) buf[m++] = ',';
+		if (k < 0 || k >= n || field_len[k] > 100) continue;
+		memcpy(buf + m, field[k], field_len[k]);
+		m += field_len[k];
+	}
+	buf[m++] = '\n';
+	if (!rnx_writer_text(&fix->out, buf, m)) fix->failed = true;
+	fix->fixes++;
+}
+
+// Close the file
+bool fix_finish(fix_conv* fix, bool quiet)
+{
+	if (!fix->fp) {
+		if (!quiet) printf("No Fix records in %s\n", fix->log);
+		return true;
+	}
+	bool ok = !fix->failed;
+	if (!rnx_writer_close(&fix->out)) ok = false;
+	if (fclose(fix->fp) != 0) ok = false;
+	fix->fp = NULL;
+	if (!ok) fprintf(stderr, "Writing the Fix CSV file of %s failed\n", fix->log);
+	return ok;
+}
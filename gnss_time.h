@@ -0,0 +1,66 @@
+/*
+// Exact GNSS time, in integer nanoseconds.
+// A gnss_time is GPS time in ns since 1980-01-06 00:00:00, which an int64 holds
+// for ±292 years without rounding. The receiver clock of a GnssLogger row gives
+// it as TimeNanos - FullBiasNanos; the sub-ns BiasNanos is applied separately,
+// in double, only where the pseudorange needs it. Weeks, days and the time of
+// week or day that each system counts its transmission time in are integer
+// floor divisions, identical on every compiler, instead of floor() and fmodl()
+// of long double products.
+*/
+#ifndef GNSS_TIME_H
+#define GNSS_TIME_H
+
+typedef long long gnss_time;            /* GPS time (ns since 1980-01-06) */
+
+#define SEC_NANO    1000000000LL        /* ns in a second, a week and a day */
+#define WEEK_NANO   604800000000000LL
+#define DAY_NANO    86400000000000LL
+#define MILLI_NANO  1000000LL
+#define BDT_NANO    (14 * SEC_NANO)     /* BeiDou time is GPS time - 14 s */
+#define GLOT_NANO   (3 * 3600 * SEC_NANO) /* GLONASS time is UTC(SU) = UTC + 3 h */
+
+// Quotient and remainder rounded towards minus infinity (b > 0), so that times
+// before an epoch fall into the previous week or day like the others
+inline long long floor_div(long long a, long long b)
+{
+	long long q = a / b;
+	return q - (a % b < 0);
+}
+
+inline long long floor_mod(long long a, long long b)
+{
+	long long r = a % b;
+	return r < 0 ? r + b : r;
+}
+
+// GPS time of the receiver clock (BiasNanos excluded)
+inline gnss_time gnss_rx_time(long long time_nano, long long full_bias_nano)
+{
+	return time_nano - full_bias_nano;
+}
+
+inline long long gnss_week(gnss_time t) { return floor_div(t, WEEK_NANO); }
+inline long long gnss_day(gnss_time t) { return floor_div(t, DAY_NANO); }
+inline long long gnss_tow(gnss_time t) { return floor_mod(t, WEEK_NANO); }   /* ns into the GPS week */
+inline long long gnss_tod(gnss_time t) { return floor_mod(t, DAY_NANO); }    /* ns into the GPS day */
+inline long long gnss_millis(gnss_time t) { return floor_div(t, MILLI_NANO); }
+
+// Time of week (BeiDou: of the BDT week) or, for GLONASS, time of day in
+// UTC(SU), in the scale that ReceivedSvTimeNanos of the system is reported in.
+// Galileo, QZSS and NavIC count the time of the GPS week. leap_seconds is GPS - UTC.
+inline long long gps_tow(gnss_time t) { return gnss_tow(t); }
+inline long long bds_tow(gnss_time t) { return floor_mod(t - BDT_NANO, WEEK_NANO); }
+inline long long glo_tod(gnss_time t, int leap_seconds)
+{
+	return floor_mod(t + GLOT_NANO - leap_seconds * SEC_NANO, DAY_NANO);
+}
+
+// Difference of two times of week or of day, brought to [-period/2, period/2)
+// when they lie on either side of a rollover
+inline long long fold_period(long long dt, long long period)
+{
+	return floor_mod(dt + period / 2, period) - period / 2;
+}
+
+#endif
@@ -0,0 +1,717 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <chrono>
+#include <thread>
+#ifdef HAVE_ZLIB
+#include <condition_variable>
+#include <mutex>
+#include <zlib.h>
+#endif
+#include "log_reader.h"
+#include "spsc_queue.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+#ifdef _WIN32
+#define FSEEK64 _fseeki64
+#else
+#define FSEEK64 fseeko
+#endif
+
+#define LOG_ZIN      (1 << 16)          /* Compressed bytes read at a time */
+
+#define LOG_GZIP     1                  /* Compressed log formats */
+#define LOG_ZIP      2
+
+static volatile sig_atomic_t follow_stop = 0;
+
+// Format of a log from its first bytes: LOG_GZIP, LOG_ZIP or 0 for text
+static int compressed_format(const unsigned char* p, size_t n)
+{
+	if (n >= 2 && p[0] == 0x1f && p[1] == 0x8b) return LOG_GZIP;
+	if (n >= 4 && p[0] == 'P' && p[1] == 'K' && p[2] == 3 && p[3] == 4) return LOG_ZIP;
+	return 0;
+}
+
+#ifdef HAVE_ZLIB
+// Inflate thread of a compressed log. It fills up to LOG_ZBLOCKS blocks ahead
+// of the line scan, which takes them in order and gives them back when read.
+struct log_inflate
+{
+	FILE* fp;
+	int format;
+	unsigned char in[LOG_ZIN];
+	size_t nin;                         /* Bytes at the start of in read to detect the format */
+
+	char* block[LOG_ZBLOCKS];
+	size_t len[LOG_ZBLOCKS];
+	int head;                           /* Next block to read */
+	int count;                          /* Inflated blocks not read yet */
+	size_t off;                         /* Bytes of the head block already read */
+	bool done;                          /* No more blocks will come */
+	bool failed;                        /* Corrupt or truncated data */
+	bool stop;                          /* The reader is closed */
+
+	std::mutex m;
+	std::condition_variable cv;
+	std::thread th;
+	bool started;
+};
+
+// Read compressed input after what is left in z->in; false at the end of the file
+static bool inflate_input(log_inflate* z, z_stream* s)
+{
+	if (s->avail_in > 0) memmove(z->in, s->next_in, s->avail_in);
+	size_t n = fread(z->in + s->avail_in, 1, LOG_ZIN - s->avail_in, z->fp);
+	s->next_in = z->in;
+	s->avail_in += (uInt)n;
+	return n > 0;
+}
+
+// Skip the local header of the first zip entry. Returns its compression method
+// (0 stored, with its size in *stored, or Z_DEFLATED), -1 if it cannot be read.
+static int zip_entry(log_inflate* z, z_stream* s, long long* stored)
+{
+	while (s->avail_in < 30 && inflate_input(z, s)) ;
+	if (s->avail_in < 30) return -1;
+
+	const unsigned char* h = s->next_in;
+	int flags = h[6] | (h[7] << 8);
+	int method = h[8] | (h[9] << 8);
+	*stored = (long long)(h[18] | (h[19] << 8) | (h[20] << 16)) | ((long long)h[21] << 24);
+	size_t skip = 30 + (h[26] | (h[27] << 8)) + (h[28] | (h[29] << 8));  /* Header, name and extra field */
+	if (method == 0 && (flags & 0x08)) return -1;  /* Stored entry of unknown size */
+	if (method != 0 && method != Z_DEFLATED) return -1;
+
+	while (skip > 0) {
+		if (s->avail_in == 0 && !inflate_input(z, s)) return -1;
+		size_t n = skip < s->avail_in ? skip : s->avail_in;
+		s->next_in += n;
+		s->avail_in -= (uInt)n;
+		skip -= n;
+	}
+	return method;
+}
+
+static void inflate_run(log_inflate* z)
+{
+	z_stream s;
+	memset(&s, 0, sizeof(s));
+	s.next_in = z->in;
+	s.avail_in = (uInt)z->nin;
+
+	bool ok;
+	int method = Z_DEFLATED;
+	long long stored = 0;               /* Zip: bytes left of a stored entry */
+	if (z->format == LOG_ZIP) {
+		method = zip_entry(z, &s, &stored);
+		ok = method == 0 || (method == Z_DEFLATED && inflateInit2(&s, -MAX_WBITS) == Z_OK);
+	}
+	else ok = inflateInit2(&s, MAX_WBITS + 16) == Z_OK;
+
+	bool end = !ok;
+	while (!end) {
+		int b;
+		{
+			std::unique_lock<std::mutex> lock(z->m);
+			z->cv.wait(lock, [z] { return z->stop || z->count < LOG_ZBLOCKS; });
+			if (z->stop) break;
+			b = (z->head + z->count) % LOG_ZBLOCKS;
+		}
+
+		// Fill block b
+		size_t n = 0;
+		while (n < LOG_ZBLOCK && !end) {
+			if (method == 0 && stored == 0) {
+				end = true;
+				break;
+			}
+			if (s.avail_in == 0 && !inflate_input(z, &s)) {
+				ok = false;             /* Truncated */
+				end = true;
+				break;
+			}
+			if (method == 0) {
+				size_t k = LOG_ZBLOCK - n < s.avail_in ? LOG_ZBLOCK - n : s.avail_in;
+				if ((long long)k > stored) k = (size_t)stored;
+				memcpy(z->block[b] + n, s.next_in, k);
+				s.next_in += k;
+				s.avail_in -= (uInt)k;
+				stored -= k;
+				n += k;
+				continue;
+			}
+			s.next_out = (Bytef*)z->block[b] + n;
+			s.avail_out = (uInt)(LOG_ZBLOCK - n);
+			int ret = inflate(&s, Z_NO_FLUSH);
+			n = LOG_ZBLOCK - s.avail_out;
+			if (ret == Z_STREAM_END) {
+				// A gzip file may hold several members, e.g. logs concatenated with cat
+				if (z->format == LOG_GZIP && (s.avail_in > 0 || inflate_input(z, &s)) && s.next_in[0] == 0x1f) inflateReset(&s);
+				else end = true;
+			}
+			else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				ok = false;
+				end = true;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(z->m);
+		z->len[b] = n;
+		z->count++;
+		z->cv.notify_all();
+	}
+	if (method == Z_DEFLATED) inflateEnd(&s);
+
+	std::lock_guard<std::mutex> lock(z->m);
+	z->failed = !ok;
+	z->done = true;
+	z->cv.notify_all();
+}
+
+// Set up the inflating of a compressed log; the thread starts at the first read
+static bool open_inflate(log_reader* rd, FILE* fp, int format, const char* head, size_t n)
+{
+	log_inflate* z = new log_inflate();
+	z->fp = fp;
+	z->format = format;
+	memcpy(z->in, head, n);
+	z->nin = n;
+	for (int i = 0; i < LOG_ZBLOCKS; i++) {
+		z->block[i] = (char*)malloc(LOG_ZBLOCK);
+		if (!z->block[i]) {
+			for (int k = 0; k < i; k++) free(z->block[k]);
+			delete z;
+			return false;
+		}
+	}
+	rd->z = z;
+	return true;
+}
+
+// Copy inflated data into buf, waiting for the inflate thread; 0 at the end
+static size_t inflate_read(log_reader* rd, char* buf, size_t size)
+{
+	log_inflate* z = rd->z;
+	if (!z->started) {
+		z->started = true;
+		z->th = std::thread(inflate_run, z);
+	}
+
+	size_t n = 0;
+	std::unique_lock<std::mutex> lock(z->m);
+	while (n < size) {
+		z->cv.wait(lock, [z] { return z->count > 0 || z->done; });
+		if (z->count == 0) {
+			if (z->failed) rd->failed = true;
+			break;
+		}
+		size_t k = z->len[z->head] - z->off;
+		if (k > size - n) k = size - n;
+		memcpy(buf + n, z->block[z->head] + z->off, k);
+		n += k;
+		z->off += k;
+		if (z->off == z->len[z->head]) {
+			z->head = (z->head + 1) % LOG_ZBLOCKS;
+			z->count--;
+			z->off = 0;
+			z->cv.notify_all();
+		}
+	}
+	return n;
+}
+
+static void close_inflate(log_reader* rd)
+{
+	log_inflate* z = rd->z;
+	if (z->started) {
+		{
+			std::lock_guard<std::mutex> lock(z->m);
+			z->stop = true;
+			z->cv.notify_all();
+		}
+		z->th.join();
+	}
+	fclose(z->fp);
+	for (int i = 0; i < LOG_ZBLOCKS; i++) free(z->block[i]);
+	delete z;
+	rd->z = NULL;
+}
+#endif
+
+// Map the whole file read-only; returns false if the file cannot be mapped
+static bool map_file(log_reader* rd, const char* file)
+{
+#ifdef _WIN32
+	HANDLE hf = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hf == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hf, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1) {
+		CloseHandle(hf);
+		return false;
+	}
+	HANDLE hm = CreateFileMappingA(hf, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!hm) {
+		CloseHandle(hf);
+		return false;
+	}
+	void* view = MapViewOfFile(hm, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(hm);
+		CloseHandle(hf);
+		return false;
+	}
+	rd->data = (const char*)view;
+	rd->size = (size_t)size.QuadPart;
+	rd->map_handle = hm;
+	rd->file_handle = hf;
+#else
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) return false;
+	madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	rd->data = (const char*)view;
+	rd->size = (size_t)st.st_size;
+#endif
+	rd->mapped = true;
+	return true;
+}
+
+static void unmap_file(log_reader* rd)
+{
+#ifdef _WIN32
+	UnmapViewOfFile((LPCVOID)rd->data);
+	CloseHandle((HANDLE)rd->map_handle);
+	CloseHandle((HANDLE)rd->file_handle);
+#else
+	munmap((void*)rd->data, rd->size);
+#endif
+	rd->mapped = false;
+}
+
+bool log_open(log_reader* rd, const char* file)
+{
+	memset(rd, 0, sizeof(log_reader));
+
+	if (map_file(rd, file)) {
+		if (!compressed_format((const unsigned char*)rd->data, rd->size)) return true;
+		unmap_file(rd);
+	}
+
+	// Not mappable (empty file, pipe, too large for the address space) or
+	// compressed: read in blocks
+	rd->fp = fopen(file, "rb");
+	if (!rd->fp) return false;
+	rd->buf = (char*)malloc(LOG_BUFSIZE);
+	if (!rd->buf) {
+		fclose(rd->fp);
+		rd->fp = NULL;
+		return false;
+	}
+	rd->data = rd->buf;
+
+	// The first bytes tell a compressed log; a text log keeps them as its first data
+	rd->size = fread(rd->buf, 1, 4, rd->fp);
+	int format = compressed_format((const unsigned char*)rd->buf, rd->size);
+	if (format) {
+#ifdef HAVE_ZLIB
+		if (open_inflate(rd, rd->fp, format, rd->buf, rd->size)) {
+			rd->fp = NULL;
+			rd->size = 0;
+			return true;
+		}
+#else
+		fprintf(stderr, "%s is compressed; reading it needs a build with zlib (HAVE_ZLIB)\n", file);
+#endif
+		log_close(rd);
+		return false;
+	}
+	return true;
+}
+
+// Reader thread of a text log (pipeline). It reads the file into LOG_PBLOCKS
+// blocks ahead of the line scan; the blocks go to the scan through one queue
+// and come back empty through the other.
+struct log_pipe
+{
+	FILE* fp;
+	char* block[LOG_PBLOCKS];
+	size_t len[LOG_PBLOCKS];
+	spsc_queue<int, LOG_PBLOCKS> full;  /* Blocks read, in file order */
+	spsc_queue<int, LOG_PBLOCKS> empty; /* Blocks the line scan is done with */
+	int cur;                            /* Block being scanned, -1 if none */
+	size_t off;                         /* Bytes of it already scanned */
+	bool failed;                        /* Read error, set before full is closed */
+	unsigned long long read_stalls;     /* Waits of the thread for an empty block */
+	std::thread th;
+};
+
+static char* alloc_block(size_t size)
+{
+#ifdef _WIN32
+	return (char*)_aligned_malloc(size, LOG_PALIGN);
+#else
+	void* p = NULL;
+	return posix_memalign(&p, LOG_PALIGN, size) == 0 ? (char*)p : NULL;
+#endif
+}
+
+static void free_block(char* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static void pipe_run(log_pipe* p)
+{
+	int b;
+	while (p->empty.pop(&b, &p->read_stalls)) {
+		size_t n = fread(p->block[b], 1, LOG_PBLOCK, p->fp);
+		p->len[b] = n;
+		if (n > 0 && !p->full.push(b, &p->read_stalls)) break;
+		if (n < LOG_PBLOCK) {
+			p->failed = ferror(p->fp) != 0;
+			break;
+		}
+	}
+	p->full.close();
+}
+
+// Copy the blocks of the reader thread into buf, waiting for them; 0 at the end
+static size_t pipe_read(log_reader* rd, char* buf, size_t size)
+{
+	log_pipe* p = rd->pipe;
+	size_t n = 0;
+	unsigned long long unused = 0;
+	while (n < size) {
+		if (p->cur < 0) {
+			if (!p->full.pop(&p->cur, &rd->scan_stalls)) {
+				if (p->failed) rd->failed = true;
+				break;
+			}
+			p->off = 0;
+		}
+		size_t k = p->len[p->cur] - p->off;
+		if (k > size - n) k = size - n;
+		memcpy(buf + n, p->block[p->cur] + p->off, k);
+		n += k;
+		p->off += k;
+		if (p->off == p->len[p->cur]) {
+			p->empty.push(p->cur, &unused);  /* Never waits: there are only LOG_PBLOCKS blocks */
+			p->cur = -1;
+		}
+	}
+	return n;
+}
+
+// Stop the reader thread, at the end of the file or not
+static void stop_pipe(log_pipe* p)
+{
+	if (!p->th.joinable()) return;
+	p->full.close();
+	p->empty.close();
+	p->th.join();
+}
+
+static void close_pipe(log_reader* rd)
+{
+	log_pipe* p = rd->pipe;
+	stop_pipe(p);
+	fclose(p->fp);
+	for (int i = 0; i < LOG_PBLOCKS; i++) free_block(p->block[i]);
+	delete p;
+	rd->pipe = NULL;
+}
+
+// Open a text log to be read by a reader thread of its own (pipeline), from
+// the given offset on. A compressed log has its inflate thread instead, as with
+// log_open, and is read from the start.
+bool log_open_pipe(log_reader* rd, const char* file, unsigned long long offset)
+{
+	if (!log_open(rd, file)) return false;
+	if (rd->z) return true;
+	if (rd->mapped) unmap_file(rd);
+	else {
+		fclose(rd->fp);
+		rd->fp = NULL;
+	}
+
+	log_pipe* p = new log_pipe();
+	p->fp = fopen(file, "rb");
+	p->cur = -1;
+	bool ok = p->fp != NULL;
+	for (int i = 0; i < LOG_PBLOCKS; i++) {
+		p->block[i] = ok ? alloc_block(LOG_PBLOCK) : NULL;
+		if (!p->block[i]) ok = false;
+		else p->empty.try_push(i);
+	}
+	if (!rd->buf) rd->buf = (char*)malloc(LOG_BUFSIZE);
+	if (!ok || !rd->buf) {
+		if (p->fp) fclose(p->fp);
+		for (int i = 0; i < LOG_PBLOCKS; i++) free_block(p->block[i]);
+		delete p;
+		log_close(rd);
+		return false;
+	}
+
+	// Whole blocks go straight from the file into the block, without the stdio buffer
+	setvbuf(p->fp, NULL, _IONBF, 0);
+	if (offset > 0 && FSEEK64(p->fp, (long long)offset, SEEK_SET) != 0) offset = 0;
+#if defined(__linux__)
+	posix_fadvise(fileno(p->fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	p->th = std::thread(pipe_run, p);
+	rd->pipe = p;
+	rd->data = rd->buf;
+	rd->size = 0;
+	rd->pos = 0;
+	rd->base = offset;
+	return true;
+}
+
+// Stall counters of the pipeline reader: waits of the reader thread for the
+// line scan, and of the line scan for the reader thread. Stops the thread.
+void log_pipe_stalls(log_reader* rd, unsigned long long* read, unsigned long long* scan)
+{
+	*read = 0;
+	*scan = rd->scan_stalls;
+	if (!rd->pipe) return;
+	stop_pipe(rd->pipe);
+	*read = rd->pipe->read_stalls;
+}
+
+// Continue reading a text log at the given offset, the start of a line (before
+// the first line is read in the buffered case)
+bool log_seek(log_reader* rd, unsigned long long offset)
+{
+	if (rd->mapped) {
+		if (offset > rd->size) return false;
+		rd->pos = (size_t)offset;
+		return true;
+	}
+	if (!rd->fp || rd->follow || FSEEK64(rd->fp, (long long)offset, SEEK_SET) != 0) return false;
+	rd->data = rd->buf;
+	rd->size = 0;
+	rd->pos = 0;
+	rd->base = offset;
+	rd->eof = false;
+	return true;
+}
+
+// Read the lines of a block of memory, e.g. a slice of a mapped file
+void log_open_mem(log_reader* rd, const char* data, size_t size)
+{
+	memset(rd, 0, sizeof(log_reader));
+	rd->data = data;
+	rd->size = size;
+	rd->eof = true;
+}
+
+// Open a log that is still being written: a growing file, a FIFO, or stdin ("-").
+// The log ends at the end of a pipe, after idle_ms without new data (if not 0),
+// or when log_stop_follow is called.
+bool log_open_follow(log_reader* rd, const char* file, int idle_ms)
+{
+	memset(rd, 0, sizeof(log_reader));
+	rd->notify = -1;
+
+	bool is_stdin = strcmp(file, "-") == 0;
+#ifdef _WIN32
+	rd->fd = is_stdin ? _fileno(stdin) : _open(file, _O_RDONLY | _O_BINARY);
+	if (is_stdin) _setmode(rd->fd, _O_BINARY);
+	struct _stat st;
+	rd->growing = rd->fd >= 0 && _fstat(rd->fd, &st) == 0 && (st.st_mode & _S_IFREG);
+#else
+	rd->fd = is_stdin ? STDIN_FILENO : open(file, O_RDONLY);
+	struct stat st;
+	rd->growing = rd->fd >= 0 && fstat(rd->fd, &st) == 0 && S_ISREG(st.st_mode);
+#endif
+	if (rd->fd < 0) return false;
+
+#ifdef __linux__
+	if (rd->growing) {
+		rd->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (rd->notify >= 0 && inotify_add_watch(rd->notify, file, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+			close(rd->notify);
+			rd->notify = -1;
+		}
+	}
+#endif
+
+	rd->buf = (char*)malloc(LOG_BUFSIZE);
+	if (!rd->buf) {
+#ifdef _WIN32
+		if (!is_stdin) _close(rd->fd);
+#else
+		if (!is_stdin) close(rd->fd);
+#endif
+		rd->fd = -1;
+		return false;
+	}
+	rd->data = rd->buf;
+	rd->follow = true;
+	rd->idle_ms = idle_ms;
+	return true;
+}
+
+// End all followed logs at their current end; safe to call from a signal handler
+void log_stop_follow()
+{
+	follow_stop = 1;
+}
+
+// Wait until the followed log may have new data or LOG_WAIT_MS have passed
+static void wait_data(log_reader* rd)
+{
+#ifdef _WIN32
+	Sleep(LOG_POLL_MS);
+#else
+	if (!rd->growing) {
+		struct pollfd pfd = { rd->fd, POLLIN, 0 };
+		poll(&pfd, 1, LOG_WAIT_MS);
+		return;
+	}
+#ifdef __linux__
+	if (rd->notify >= 0) {
+		struct pollfd pfd = { rd->notify, POLLIN, 0 };
+		if (poll(&pfd, 1, LOG_WAIT_MS) > 0) {
+			char events[4096];
+			while (read(rd->notify, events, sizeof(events)) > 0) ;
+		}
+		return;
+	}
+#endif
+	usleep(LOG_POLL_MS * 1000);
+#endif
+}
+
+// Read what the followed log has, waiting for it to grow; 0 at the end of the log
+static size_t follow_read(log_reader* rd, char* buf, size_t size)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	for (;;) {
+		if (follow_stop) return 0;
+#ifndef _WIN32
+		if (!rd->growing) {
+			struct pollfd pfd = { rd->fd, POLLIN, 0 };
+			if (poll(&pfd, 1, 0) == 0) {
+				wait_data(rd);
+				continue;
+			}
+		}
+		long n = (long)read(rd->fd, buf, size);
+#else
+		long n = _read(rd->fd, buf, (unsigned int)size);
+#endif
+		if (n > 0) {
+			return (size_t)n;
+		}
+		if (n < 0 && errno != EINTR && errno != EAGAIN) return 0;
+		if (n == 0 && !rd->growing) return 0;  /* End of the pipe */
+
+		if (rd->idle_ms > 0 && std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds(rd->idle_ms)) return 0;
+		wait_data(rd);
+	}
+}
+
+// Move the incomplete tail of the buffer to the front and read the next block
+static bool refill(log_reader* rd)
+{
+	if (rd->mapped || rd->eof) return false;
+
+	size_t rest = rd->size - rd->pos;
+	if (rest == LOG_BUFSIZE) rest = 0; /* Line longer than the buffer: drop it */
+	rd->base += rd->size - rest;
+	memmove(rd->buf, rd->buf + rd->size - rest, rest);
+	rd->pos = 0;
+	rd->size = rest;
+
+	size_t n;
+#ifdef HAVE_ZLIB
+	if (rd->z) n = inflate_read(rd, rd->buf + rest, LOG_BUFSIZE - rest);
+	else
+#endif
+	if (rd->pipe) n = pipe_read(rd, rd->buf + rest, LOG_BUFSIZE - rest);
+	else n = rd->follow ? follow_read(rd, rd->buf + rest, LOG_BUFSIZE - rest)
+		: fread(rd->buf + rest, 1, LOG_BUFSIZE - rest, rd->fp);
+	if (n == 0) rd->eof = true;
+	rd->size += n;
+	return n > 0;
+}
+
+// Return the next line (without the line break) as a pointer into the reader's data
+bool log_next_line(log_reader* rd, const char** line, size_t* len)
+{
+	for (;;) {
+		const char* p = rd->data + rd->pos;
+		size_t avail = rd->size - rd->pos;
+		const char* nl = avail ? (const char*)memchr(p, '\n', avail) : NULL;
+
+		if (!nl && avail && rd->eof && rd->follow) { /* Cut off mid-write when following ended */
+			rd->pos = rd->size;
+			rd->cut = true;
+			return false;
+		}
+		if (nl || (avail && (rd->mapped || rd->eof))) {
+			size_t n = nl ? (size_t)(nl - p) : avail;
+			rd->pos += nl ? n + 1 : n;
+			if (n > 0 && p[n - 1] == '\r') n--;
+			*line = p;
+			*len = n;
+			return true;
+		}
+		if (!refill(rd) && !(rd->eof && rd->size > rd->pos)) return false;
+	}
+}
+
+void log_close(log_reader* rd)
+{
+	if (rd->mapped) unmap_file(rd);
+	if (rd->fp) fclose(rd->fp);
+#ifdef HAVE_ZLIB
+	if (rd->z) close_inflate(rd);
+#endif
+	if (rd->pipe) close_pipe(rd);
+	if (rd->follow) {
+#ifdef _WIN32
+		if (rd->fd != _fileno(stdin)) _close(rd->fd);
+#else
+		if (rd->fd != STDIN_FILENO) close(rd->fd);
+		if (rd->notify >= 0) close(rd->notify);
+#endif
+	}
+	free(rd->buf);
+	memset(rd, 0, sizeof(log_reader));
+}
@@ -0,0 +1,108 @@
+/*
+// Line reader for GnssLogger csv files (.txt).
+// The file is memory mapped when possible and scanned once; lines are handed
+// out as pointers into the mapped (or buffered) data, without copies or
+// per-line heap allocation. Numeric fields are parsed in place, locale free.
+// In follow mode a log that is still being written is read as it grows, and
+// lines are handed out as soon as they are complete; a last line that is still
+// incomplete when following ends (a row cut off mid-write) is dropped.
+// Logs compressed with gzip (.txt.gz) or zip (.zip, first entry) are inflated
+// by a thread of their own into blocks that the line scan reads, so inflating
+// overlaps the parsing (builds with HAVE_ZLIB).
+// In pipeline mode a text log is read likewise by a reader thread of its own,
+// in large page-aligned blocks handed over through a lock-free queue, so that
+// slow or network storage is read while the lines already read are converted.
+*/
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <charconv>
+
+#define LOG_BUFSIZE  (1 << 20)          /* Buffer size when the input cannot be mapped */
+#define LOG_WAIT_MS  100                /* Longest wait for new data before checking for a stop */
+#define LOG_POLL_MS  10                 /* Polling period of a growing file without change notification */
+#define LOG_ZBLOCK   (1 << 18)          /* Inflated bytes handed from the inflate thread at a time */
+#define LOG_ZBLOCKS  4                  /* Inflated blocks in flight */
+#define LOG_PBLOCK   (1 << 22)          /* Bytes read at a time by the reader thread (pipeline) */
+#define LOG_PBLOCKS  4                  /* Blocks in flight between the reader thread and the line scan */
+#define LOG_PALIGN   4096               /* Alignment of the blocks */
+
+struct log_inflate;
+struct log_pipe;
+
+struct log_reader
+{
+	const char* data;    /* Mapped file or read buffer */
+	size_t size;         /* Valid bytes in data */
+	size_t pos;          /* Start of the next line */
+	unsigned long long base; /* File offset of data[0] */
+
+	// Memory mapping
+	bool mapped;
+	void* map_handle;
+	void* file_handle;
+
+	// Buffered fallback
+	FILE* fp;
+	char* buf;
+	bool eof;
+
+	// Follow mode: a log that is still being written (growing file, pipe, stdin)
+	bool follow;
+	int fd;
+	bool growing;        /* Regular file: end of data is not the end of the log */
+	int notify;          /* inotify descriptor of the file, -1 if none */
+	int idle_ms;         /* End the log after this long without new data, 0 = never */
+	bool cut;            /* An incomplete last line was dropped at the end */
+
+	// Compressed log
+	log_inflate* z;      /* Inflate thread and its blocks, NULL for a text file */
+	bool failed;         /* The log could not be read to its end (corrupt compressed data) */
+
+	// Pipeline: text log read ahead by a reader thread
+	log_pipe* pipe;      /* Reader thread and its blocks, NULL if not used */
+	unsigned long long scan_stalls; /* Waits of the line scan for the reader thread */
+};
+
+bool log_open(log_reader* rd, const char* file);
+void log_open_mem(log_reader* rd, const char* data, size_t size);
+bool log_open_pipe(log_reader* rd, const char* file, unsigned long long offset = 0);
+bool log_seek(log_reader* rd, unsigned long long offset);
+void log_pipe_stalls(log_reader* rd, unsigned long long* read, unsigned long long* scan);
+bool log_open_follow(log_reader* rd, const char* file, int idle_ms);
+void log_stop_follow();
+bool log_next_line(log_reader* rd, const char** line, size_t* len);
+void log_close(log_reader* rd);
+
+// File offset of a line returned by log_next_line (text logs)
+inline unsigned long long log_offset(const log_reader* rd, const char* line)
+{
+	return rd->base + (unsigned long long)(line - rd->data);
+}
+
+// Parse an integer field [p,e); an empty field reads as 0 and any fraction is dropped
+inline long long log_parse_ll(const char* p, const char* e)
+{
+	long long v = 0;
+	if (p < e && *p == '+') p++;
+	std::from_chars(p, e, v);
+	return v;
+}
+
+inline int log_parse_int(const char* p, const char* e)
+{
+	return (int)log_parse_ll(p, e);
+}
+
+// Parse a floating point field [p,e); an empty field reads as 0
+inline double log_parse_double(const char* p, const char* e)
+{
+	double v = 0.0;
+	if (p < e && *p == '+') p++;
+	std::from_chars(p, e, v);
+	return v;
+}
+
+#endif
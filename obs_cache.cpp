@@ -0,0 +1,228 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <string.h>
+
+#include "obs_cache.h"
+
+#define OBC_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+// Element size of each column, in the order of the file
+static const size_t obc_width[OBC_NCOLUMNS] = {
+	sizeof(long long), sizeof(long long), sizeof(double), sizeof(int),
+	sizeof(int), sizeof(double), sizeof(int), sizeof(long long),
+	sizeof(long long), sizeof(double), sizeof(double), sizeof(double),
+	sizeof(int), sizeof(double), sizeof(double), sizeof(unsigned char)
+};
+
+// Columns of the table in the order of the file
+static void table_columns(const obs_table* t, const void** col)
+{
+	col[0] = t->time_nano.data();
+	col[1] = t->full_bias_nano.data();
+	col[2] = t->bias_nano.data();
+	col[3] = t->hardware_clock_discountinuity_count.data();
+	col[4] = t->svid.data();
+	col[5] = t->time_offset_nano.data();
+	col[6] = t->state.data();
+	col[7] = t->received_sv_time_nano.data();
+	col[8] = t->received_sv_time_uncertainty_nano.data();
+	col[9] = t->cn0_dbhz.data();
+	col[10] = t->pseudorange_rate_meter_per_second.data();
+	col[11] = t->pseudorange_rate_uncertainty_meter_per_second.data();
+	col[12] = t->accumulated_delta_range_state.data();
+	col[13] = t->accumulated_delta_range_meter.data();
+	col[14] = t->carrier_frequency_hz.data();
+	col[15] = t->constellation_type.data();
+}
+
+// True if the data is a complete cache file of this version
+bool obc_is_cache(const char* data, size_t size)
+{
+	if (size < sizeof(obc_header) || memcmp(data, OBC_MAGIC, 8) != 0) return false;
+
+	obc_header h;
+	memcpy(&h, data, sizeof(h));
+	if (h.version != OBC_VERSION || h.endian != OBC_ENDIAN || h.ncolumns != OBC_NCOLUMNS) {
+		fprintf(stderr, "Cache file of another version or byte order; convert the log again\n");
+		return false;
+	}
+	if (h.index_pos == 0 || h.index_pos + h.nblocks * 8 > size) {
+		fprintf(stderr, "Incomplete cache file; convert the log again\n");
+		return false;
+	}
+	return true;
+}
+
+size_t obc_nblocks(const char* data)
+{
+	return (size_t)((const obc_header*)data)->nblocks;
+}
+
+// Columns of block k of a mapped cache file
+bool obc_get_block(const char* data, size_t size, size_t k, obc_block* b)
+{
+	const obc_header* h = (const obc_header*)data;
+	const unsigned long long* index = (const unsigned long long*)(data + h->index_pos);
+	if (k >= h->nblocks || index[k] + sizeof(obc_block_header) > size) return false;
+
+	const obc_block_header* bh = (const obc_block_header*)(data + index[k]);
+	if (index[k] + bh->size > size) return false;
+	size_t n = (size_t)bh->nrows;
+
+	const void* col[OBC_NCOLUMNS];
+	const char* p = (const char*)(bh + 1);
+	for (int c = 0; c < OBC_NCOLUMNS; c++) {
+		col[c] = p;
+		p += OBC_ALIGN(n * obc_width[c]);
+	}
+	if (p > data + index[k] + bh->size) return false;
+
+	b->nrows = n;
+	b->time_nano = (const long long*)col[0];
+	b->full_bias_nano = (const long long*)col[1];
+	b->bias_nano = (const double*)col[2];
+	b->hardware_clock_discountinuity_count = (const int*)col[3];
+	b->svid = (const int*)col[4];
+	b->time_offset_nano = (const double*)col[5];
+	b->state = (const int*)col[6];
+	b->received_sv_time_nano = (const long long*)col[7];
+	b->received_sv_time_uncertainty_nano = (const long long*)col[8];
+	b->cn0_dbhz = (const double*)col[9];
+	b->pseudorange_rate_meter_per_second = (const double*)col[10];
+	b->pseudorange_rate_uncertainty_meter_per_second = (const double*)col[11];
+	b->accumulated_delta_range_state = (const int*)col[12];
+	b->accumulated_delta_range_meter = (const double*)col[13];
+	b->carrier_frequency_hz = (const double*)col[14];
+	b->constellation_type = (const unsigned char*)col[15];
+	return true;
+}
+
+// Append rows [i0,i1) of a block to a table, as add_row() would from their lines
+void obc_append(obs_table* t, const obc_block* b, size_t i0, size_t i1)
+{
+	t->time_nano.insert(t->time_nano.end(), b->time_nano + i0, b->time_nano + i1);
+	t->full_bias_nano.insert(t->full_bias_nano.end(), b->full_bias_nano + i0, b->full_bias_nano + i1);
+	t->bias_nano.insert(t->bias_nano.end(), b->bias_nano + i0, b->bias_nano + i1);
+	t->hardware_clock_discountinuity_count.insert(t->hardware_clock_discountinuity_count.end(),
+		b->hardware_clock_discountinuity_count + i0, b->hardware_clock_discountinuity_count + i1);
+	t->svid.insert(t->svid.end(), b->svid + i0, b->svid + i1);
+	t->time_offset_nano.insert(t->time_offset_nano.end(), b->time_offset_nano + i0, b->time_offset_nano + i1);
+	t->state.insert(t->state.end(), b->state + i0, b->state + i1);
+	t->received_sv_time_nano.insert(t->received_sv_time_nano.end(), b->received_sv_time_nano + i0, b->received_sv_time_nano + i1);
+	t->received_sv_time_uncertainty_nano.insert(t->received_sv_time_uncertainty_nano.end(),
+		b->received_sv_time_uncertainty_nano + i0, b->received_sv_time_uncertainty_nano + i1);
+	t->cn0_dbhz.insert(t->cn0_dbhz.end(), b->cn0_dbhz + i0, b->cn0_dbhz + i1);
+	t->pseudorange_rate_meter_per_second.insert(t->pseudorange_rate_meter_per_second.end(),
+		b->pseudorange_rate_meter_per_second + i0, b->pseudorange_rate_meter_per_second + i1);
+	t->pseudorange_rate_uncertainty_meter_per_second.insert(t->pseudorange_rate_uncertainty_meter_per_second.end(),
+		b->pseudorange_rate_uncertainty_meter_per_second + i0, b->pseudorange_rate_uncertainty_meter_per_second + i1);
+	t->accumulated_delta_range_state.insert(t->accumulated_delta_range_state.end(),
+		b->accumulated_delta_range_state + i0, b->accumulated_delta_range_state + i1);
+	t->accumulated_delta_range_meter.insert(t->accumulated_delta_range_meter.end(),
+		b->accumulated_delta_range_meter + i0, b->accumulated_delta_range_meter + i1);
+	t->carrier_frequency_hz.insert(t->carrier_frequency_hz.end(), b->carrier_frequency_hz + i0, b->carrier_frequency_hz + i1);
+	t->constellation_type.insert(t->constellation_type.end(), b->constellation_type + i0, b->constellation_type + i1);
+	t->sys.resize(t->sys.size() + (i1 - i0), 0);
+	t->frq.resize(t->frq.size() + (i1 - i0), -1);
+}
+
+static void obc_write(obc_writer* w, const void* data, size_t len)
+{
+	static const char zero[8] = { 0 };
+	if (len && fwrite(data, 1, len, w->fp) != len) w->failed = true;
+	size_t pad = OBC_ALIGN(len) - len;
+	if (pad && fwrite(zero, 1, pad, w->fp) != pad) w->failed = true;
+	w->pos += OBC_ALIGN(len);
+}
+
+// Create a cache file; the header is completed by obc_close()
+bool obc_open(obc_writer* w, const char* file)
+{
+	w->fp = fopen(file, "wb");
+	if (!w->fp) return false;
+	w->rows.clear();
+	w->index.clear();
+	w->nrows = 0;
+	w->pos = 0;
+	w->failed = false;
+
+	obc_header h;
+	memset(&h, 0, sizeof(h));
+	obc_write(w, &h, sizeof(h));
+	return !w->failed;
+}
+
+// Copy row i of a table as parsed, before it is classified
+void obc_add_row(obc_writer* w, const obs_table* t, size_t i)
+{
+	obs_table* r = &w->rows;
+	r->time_nano.push_back(t->time_nano[i]);
+	r->full_bias_nano.push_back(t->full_bias_nano[i]);
+	r->bias_nano.push_back(t->bias_nano[i]);
+	r->hardware_clock_discountinuity_count.push_back(t->hardware_clock_discountinuity_count[i]);
+	r->svid.push_back(t->svid[i]);
+	r->time_offset_nano.push_back(t->time_offset_nano[i]);
+	r->state.push_back(t->state[i]);
+	r->received_sv_time_nano.push_back(t->received_sv_time_nano[i]);
+	r->received_sv_time_uncertainty_nano.push_back(t->received_sv_time_uncertainty_nano[i]);
+	r->cn0_dbhz.push_back(t->cn0_dbhz[i]);
+	r->pseudorange_rate_meter_per_second.push_back(t->pseudorange_rate_meter_per_second[i]);
+	r->pseudorange_rate_uncertainty_meter_per_second.push_back(t->pseudorange_rate_uncertainty_meter_per_second[i]);
+	r->accumulated_delta_range_state.push_back(t->accumulated_delta_range_state[i]);
+	r->accumulated_delta_range_meter.push_back(t->accumulated_delta_range_meter[i]);
+	r->carrier_frequency_hz.push_back(t->carrier_frequency_hz[i]);
+	r->constellation_type.push_back(t->constellation_type[i]);
+	r->sys.push_back(0);
+	r->frq.push_back(-1);
+}
+
+// An epoch is complete: write the block once it has enough rows
+void obc_end_epoch(obc_writer* w)
+{
+	if (w->rows.size() < OBC_BLOCK_ROWS) return;
+	obc_write_block(w, &w->rows);
+	w->rows.clear();
+}
+
+// Write the rows of a table, whole epochs, as one block
+void obc_write_block(obc_writer* w, const obs_table* t)
+{
+	size_t n = t->size();
+	if (n == 0) return;
+
+	obc_block_header bh;
+	bh.nrows = n;
+	bh.size = sizeof(bh);
+	for (int c = 0; c < OBC_NCOLUMNS; c++) bh.size += OBC_ALIGN(n * obc_width[c]);
+
+	w->index.push_back((unsigned long long)w->pos);
+	obc_write(w, &bh, sizeof(bh));
+	const void* col[OBC_NCOLUMNS];
+	table_columns(t, col);
+	for (int c = 0; c < OBC_NCOLUMNS; c++) obc_write(w, col[c], n * obc_width[c]);
+	w->nrows += n;
+}
+
+// Write the last block and the index, then complete the header
+bool obc_close(obc_writer* w)
+{
+	if (!w->fp) return false;
+	obc_write_block(w, &w->rows);
+	w->rows.clear();
+
+	obc_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, OBC_MAGIC, 8);
+	h.version = OBC_VERSION;
+	h.endian = OBC_ENDIAN;
+	h.ncolumns = OBC_NCOLUMNS;
+	h.nrows = w->nrows;
+	h.nblocks = w->index.size();
+	h.index_pos = (unsigned long long)w->pos;
+	if (!w->index.empty()) obc_write(w, w->index.data(), w->index.size() * sizeof(unsigned long long));
+
+	if (fseek(w->fp, 0, SEEK_SET) != 0 || fwrite(&h, 1, sizeof(h), w->fp) != sizeof(h)) w->failed = true;
+	if (fclose(w->fp) != 0) w->failed = true;
+	w->fp = NULL;
+	return !w->failed;
+}
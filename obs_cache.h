@@ -0,0 +1,98 @@
+/*
+// Binary cache of parsed GnssLogger Raw observations (.obc).
+// The rows are stored as read from the log, before any classification or
+// quality check, in blocks of whole epochs; each block holds one contiguous
+// array per column of obs_table. A later run maps the file and copies the
+// columns straight into the conversion, without parsing any text, so the log
+// can be converted again with other settings at a fraction of the cost.
+//
+// Layout (native byte order, every part aligned to 8 bytes):
+//   obc_header
+//   blocks: obc_block_header, then the OBC_NCOLUMNS columns of its rows
+//   index:  file offset of each block (nblocks x 8 bytes)
+*/
+#ifndef OBS_CACHE_H
+#define OBS_CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <vector>
+
+#include "obs_table.h"
+
+#define OBC_MAGIC      "CSV2RNXC"       /* First 8 bytes of a cache file */
+#define OBC_VERSION    1                /* Incremented when the layout or the columns change */
+#define OBC_ENDIAN     0x01020304       /* Written natively; read back differently on another byte order */
+#define OBC_NCOLUMNS   16
+#define OBC_BLOCK_ROWS 32768            /* Rows of a block, completed to the end of its last epoch */
+
+struct obc_header
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int endian;
+	unsigned int ncolumns;
+	unsigned int reserved;
+	unsigned long long nrows;
+	unsigned long long nblocks;
+	unsigned long long index_pos;    /* Offset of the block index, 0 while the file is written */
+};
+
+struct obc_block_header
+{
+	unsigned long long nrows;
+	unsigned long long size;         /* Bytes of the block, header included */
+};
+
+// Columns of a block of a mapped cache file
+struct obc_block
+{
+	size_t nrows;
+	const long long* time_nano;
+	const long long* full_bias_nano;
+	const double*    bias_nano;
+	const int*       hardware_clock_discountinuity_count;
+	const int*       svid;
+	const double*    time_offset_nano;
+	const int*       state;
+	const long long* received_sv_time_nano;
+	const long long* received_sv_time_uncertainty_nano;
+	const double*    cn0_dbhz;
+	const double*    pseudorange_rate_meter_per_second;
+	const double*    pseudorange_rate_uncertainty_meter_per_second;
+	const int*       accumulated_delta_range_state;
+	const double*    accumulated_delta_range_meter;
+	const double*    carrier_frequency_hz;
+	const unsigned char* constellation_type;
+};
+
+struct obc_writer
+{
+	FILE* fp;
+	obs_table rows;                  /* Rows of the block being filled */
+	std::vector<unsigned long long> index;
+	unsigned long long nrows;
+	long long pos;                   /* File offset of the next block */
+	bool failed;
+
+	obc_writer()
+	{
+		fp = NULL;
+		nrows = 0;
+		pos = 0;
+		failed = false;
+	}
+};
+
+bool obc_is_cache(const char* data, size_t size);
+size_t obc_nblocks(const char* data);
+bool obc_get_block(const char* data, size_t size, size_t k, obc_block* b);
+void obc_append(obs_table* t, const obc_block* b, size_t i0, size_t i1);
+
+bool obc_open(obc_writer* w, const char* file);
+void obc_add_row(obc_writer* w, const obs_table* t, size_t i);
+void obc_end_epoch(obc_writer* w);
+void obc_write_block(obc_writer* w, const obs_table* t);
+bool obc_close(obc_writer* w);
+
+#endif
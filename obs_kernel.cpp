@@ -0,0 +1,177 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <string.h>
+
+#include "rnx_conv.h"
+#include "obs_kernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define OBS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define OBS_TARGET(isa)
+#else
+#define OBS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+#define OBS_LANES 8                     /* Widest vector (AVX-512); the arrays are padded to a multiple */
+
+void obs_batch::clear()
+{
+	row.clear();
+	dt_nano.clear();
+	prr.clear();
+	adr.clear();
+	freq.clear();
+}
+
+void obs_batch::push(size_t i, double dt, double prr_i, double adr_i, double freq_i)
+{
+	row.push_back(i);
+	dt_nano.push_back(dt);
+	prr.push_back(prr_i);
+	adr.push_back(adr_i);
+	freq.push_back(freq_i);
+}
+
+// Observables of the rows one at a time
+static void compute_obs_scalar(obs_batch* b, size_t n, double bias_nano)
+{
+	for (size_t k = 0; k < n; k++) {
+		double pr_second = (b->dt_nano[k] - bias_nano) * 1e-9;
+		double wavl = CLIGHT / b->freq[k];     /* Compute the wavelength as Lambda= c/f */
+		double wavl_inv = 1.0 / wavl;
+		b->pr_second[k] = pr_second;
+		b->p[k] = pr_second * CLIGHT;
+		b->d[k] = -b->prr[k] * wavl_inv;
+		b->l[k] = b->adr[k] * wavl_inv;
+	}
+}
+
+#ifdef OBS_X86
+OBS_TARGET("avx2")
+static void compute_obs_avx2(obs_batch* b, size_t n, double bias_nano)
+{
+	const __m256d ns = _mm256_set1_pd(1e-9);
+	const __m256d bias = _mm256_set1_pd(bias_nano);
+	const __m256d c = _mm256_set1_pd(CLIGHT);
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d sign = _mm256_set1_pd(-0.0);
+	for (size_t k = 0; k < n; k += 4) {
+		__m256d pr_second = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(&b->dt_nano[k]), bias), ns);
+		__m256d wavl_inv = _mm256_div_pd(one, _mm256_div_pd(c, _mm256_loadu_pd(&b->freq[k])));
+		_mm256_storeu_pd(&b->pr_second[k], pr_second);
+		_mm256_storeu_pd(&b->p[k], _mm256_mul_pd(pr_second, c));
+		_mm256_storeu_pd(&b->d[k], _mm256_mul_pd(_mm256_xor_pd(_mm256_loadu_pd(&b->prr[k]), sign), wavl_inv));
+		_mm256_storeu_pd(&b->l[k], _mm256_mul_pd(_mm256_loadu_pd(&b->adr[k]), wavl_inv));
+	}
+}
+
+OBS_TARGET("avx512f")
+static void compute_obs_avx512(obs_batch* b, size_t n, double bias_nano)
+{
+	const __m512d ns = _mm512_set1_pd(1e-9);
+	const __m512d bias = _mm512_set1_pd(bias_nano);
+	const __m512d c = _mm512_set1_pd(CLIGHT);
+	const __m512d one = _mm512_set1_pd(1.0);
+	const __m512i sign = _mm512_set1_epi64((long long)0x8000000000000000ULL);
+	for (size_t k = 0; k < n; k += 8) {
+		__m512d pr_second = _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(&b->dt_nano[k]), bias), ns);
+		__m512d wavl_inv = _mm512_div_pd(one, _mm512_div_pd(c, _mm512_loadu_pd(&b->freq[k])));
+		_mm512_storeu_pd(&b->pr_second[k], pr_second);
+		_mm512_storeu_pd(&b->p[k], _mm512_mul_pd(pr_second, c));
+		_mm512_storeu_pd(&b->d[k], _mm512_mul_pd(_mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(_mm512_loadu_pd(&b->prr[k])), sign)), wavl_inv));
+		_mm512_storeu_pd(&b->l[k], _mm512_mul_pd(_mm512_loadu_pd(&b->adr[k]), wavl_inv));
+	}
+}
+
+// The processor and the operating system support the AVX2 / AVX-512 registers
+static bool cpu_has(bool avx512)
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7) return false;
+	__cpuid(r, 1);
+	if (!(r[2] & (1 << 27)) || !(r[2] & (1 << 28))) return false;  /* OSXSAVE, AVX */
+	unsigned long long xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x06) != 0x06) return false;                       /* XMM and YMM state */
+	__cpuidex(r, 7, 0);
+	if (!avx512) return (r[1] & (1 << 5)) != 0;                     /* AVX2 */
+	return (xcr0 & 0xe0) == 0xe0 && (r[1] & (1 << 16)) != 0;        /* ZMM state, AVX512F */
+#else
+	__builtin_cpu_init();
+	return avx512 ? __builtin_cpu_supports("avx512f") != 0 : __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+struct obs_kernel
+{
+	const char* name;
+	void (*fn)(obs_batch* b, size_t n, double bias_nano);
+};
+
+static const obs_kernel kernels[] = {
+#ifdef OBS_X86
+	{ "avx512", compute_obs_avx512 },
+	{ "avx2", compute_obs_avx2 },
+#endif
+	{ "scalar", compute_obs_scalar },
+};
+
+#define NKERNEL ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+// Best kernel that the processor runs
+static const obs_kernel* select_kernel()
+{
+#ifdef OBS_X86
+	if (cpu_has(true)) return &kernels[0];
+	if (cpu_has(false)) return &kernels[1];
+#endif
+	return &kernels[NKERNEL - 1];
+}
+
+static const obs_kernel* kernel = select_kernel();
+
+// Compute the observables of the rows of the batch; ref_bias_nano is the
+// receiver clock bias of the reference epoch. No product is added to anything,
+// so the compiler has nothing to contract into an FMA with different rounding,
+// and the vector kernels run over the padding instead of ending with scalar code.
+void compute_obs(obs_batch* b, double ref_bias_nano)
+{
+	if (b->size() == 0) return;
+	size_t n = (b->size() + OBS_LANES - 1) / OBS_LANES * OBS_LANES;
+	b->dt_nano.resize(n, 0.0);
+	b->prr.resize(n, 0.0);
+	b->adr.resize(n, 0.0);
+	b->freq.resize(n, 1.0);
+	b->pr_second.resize(n);
+	b->p.resize(n);
+	b->l.resize(n);
+	b->d.resize(n);
+	kernel->fn(b, n, ref_bias_nano);
+}
+
+const char* obs_kernel_name()
+{
+	return kernel->name;
+}
+
+// Use the named kernel instead (benchmarks and comparisons); false if the
+// processor cannot run it or there is none by that name
+bool set_obs_kernel(const char* name)
+{
+	for (int k = 0; k < NKERNEL; k++) {
+		if (strcmp(kernels[k].name, name) != 0) continue;
+#ifdef OBS_X86
+		if (k == 0 && !cpu_has(true)) return false;
+		if (k == 1 && !cpu_has(false)) return false;
+#endif
+		kernel = &kernels[k];
+		return true;
+	}
+	return false;
+}
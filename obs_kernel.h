@@ -0,0 +1,42 @@
+/*
+// Batch kernel for the observables of an epoch.
+// conv_rows() gathers the rows that pass the quality checks into contiguous
+// arrays; the kernel then computes the pseudorange time, pseudorange, carrier
+// phase and Doppler of all of them at once, in double precision. On x86-64 an
+// AVX-512 or AVX2 version is chosen at run time according to the processor;
+// the scalar version is used elsewhere. Every version performs the same IEEE
+// operations in the same order, so they give the same results bit for bit.
+*/
+#ifndef OBS_KERNEL_H
+#define OBS_KERNEL_H
+
+#include <vector>
+#include <stddef.h>
+
+// Rows of an epoch that passed the quality checks, and their observables
+struct obs_batch
+{
+	std::vector<size_t> row;            /* Row in the obs_table */
+
+	// Input
+	std::vector<double> dt_nano;        /* Time of reception minus time of transmission (ns) */
+	std::vector<double> prr;            /* Pseudorange rate (m/s) */
+	std::vector<double> adr;            /* Accumulated delta range (m) */
+	std::vector<double> freq;           /* Carrier frequency (Hz) */
+
+	// Output
+	std::vector<double> pr_second;      /* Pseudorange time (s), before the rollover checks */
+	std::vector<double> p;              /* Pseudorange (m) */
+	std::vector<double> l;              /* Carrier phase (cycles) */
+	std::vector<double> d;              /* Doppler (Hz) */
+
+	size_t size() const { return row.size(); }
+	void clear();
+	void push(size_t i, double dt, double prr_i, double adr_i, double freq_i);
+};
+
+void compute_obs(obs_batch* b, double ref_bias_nano);
+const char* obs_kernel_name();
+bool set_obs_kernel(const char* name);
+
+#endif
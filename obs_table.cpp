@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include "obs_table.h"
+#include "log_reader.h"
+
+// Append a Raw line of the log created by GnssLogger App in Android v.7 or higher.
+// The fields of [str,end) are parsed in place; empty fields read as 0.
+bool obs_table::add_row(const char* str, const char* end)
+{
+	long long t_nano = 0, fb_nano = 0, rx_sv = 0, rx_sv_unc = 0;
+	double b_nano = 0, toff = 0, cn0 = 0, prr = 0, prr_unc = 0, adr = 0, freq = 0;
+	int disc = 0, prn = 0, st = 0, adr_st = 0, cons = 0;
+
+	const char* p = (const char*)memchr(str, ',', end - str); // Skip the "Raw" tag
+	int field_index = 0;
+
+	while (p != NULL && field_index <= 27) {
+		const char* token = p + 1;
+		p = (const char*)memchr(token, ',', end - token);
+		const char* e = p ? p : end;
+
+		switch (field_index) {
+		case (1): t_nano = log_parse_ll(token, e); break;
+		case (4): fb_nano = log_parse_ll(token, e); break;
+		case (5): b_nano = log_parse_double(token, e); break;
+		case (9): disc = log_parse_int(token, e); break;
+		case (10):prn = log_parse_int(token, e); break;
+		case (11):toff = log_parse_double(token, e); break;
+		case (12):st = log_parse_int(token, e); break;
+		case (13):rx_sv = log_parse_ll(token, e); break;
+		case (14):rx_sv_unc = log_parse_ll(token, e); break;
+		case (15):cn0 = log_parse_double(token, e); break;
+		case (16):prr = log_parse_double(token, e); break;
+		case (17):prr_unc = log_parse_double(token, e); break;
+		case (18):adr_st = log_parse_int(token, e); break;
+		case (19):adr = log_parse_double(token, e); break;
+		case (21):freq = log_parse_double(token, e); break;
+		case (27):cons = log_parse_int(token, e); break;
+		default:break; /* Columns not used by the conversion */
+		}
+		field_index++;
+	}
+	if (field_index < 2) return false;
+
+	time_nano.push_back(t_nano);
+	full_bias_nano.push_back(fb_nano);
+	bias_nano.push_back(b_nano);
+	hardware_clock_discountinuity_count.push_back(disc);
+	svid.push_back(prn);
+	time_offset_nano.push_back(toff);
+	state.push_back(st);
+	received_sv_time_nano.push_back(rx_sv);
+	received_sv_time_uncertainty_nano.push_back(rx_sv_unc);
+	cn0_dbhz.push_back(cn0);
+	pseudorange_rate_meter_per_second.push_back(prr);
+	pseudorange_rate_uncertainty_meter_per_second.push_back(prr_unc);
+	accumulated_delta_range_state.push_back(adr_st);
+	accumulated_delta_range_meter.push_back(adr);
+	carrier_frequency_hz.push_back(freq);
+	constellation_type.push_back((unsigned char)cons);
+	sys.push_back(0);
+	frq.push_back(-1);
+	return true;
+}
+
+// Parse the clock columns at the start of a Raw row and, if signal is set, the
+// carrier frequency and constellation type further on. The columns in between
+// are only stepped over, and the row is not read past the constellation type.
+bool read_raw_head(const char* str, const char* end, raw_head* h, bool signal)
+{
+	memset(h, 0, sizeof(raw_head));
+	const char* p = (const char*)memchr(str, ',', end - str); // Skip the "Raw" tag
+	int field_index = 0;
+	int last = signal ? 27 : 9;
+
+	while (p != NULL && field_index <= last) {
+		const char* token = p + 1;
+		p = (const char*)memchr(token, ',', end - token);
+		const char* e = p ? p : end;
+
+		switch (field_index) {
+		case (1): h->time_nano = log_parse_ll(token, e); break;
+		case (4): h->full_bias_nano = log_parse_ll(token, e); break;
+		case (5): h->bias_nano = log_parse_double(token, e); break;
+		case (9): h->hardware_clock_discountinuity_count = log_parse_int(token, e); break;
+		case (21):h->carrier_frequency_hz = log_parse_double(token, e); break;
+		case (27):h->constellation_type = log_parse_int(token, e); break;
+		default:break;
+		}
+		field_index++;
+	}
+	return field_index >= 2;
+}
+
+void obs_table::reserve(size_t n)
+{
+	time_nano.reserve(n);
+	full_bias_nano.reserve(n);
+	bias_nano.reserve(n);
+	hardware_clock_discountinuity_count.reserve(n);
+	svid.reserve(n);
+	time_offset_nano.reserve(n);
+	state.reserve(n);
+	received_sv_time_nano.reserve(n);
+	received_sv_time_uncertainty_nano.reserve(n);
+	cn0_dbhz.reserve(n);
+	pseudorange_rate_meter_per_second.reserve(n);
+	pseudorange_rate_uncertainty_meter_per_second.reserve(n);
+	accumulated_delta_range_state.reserve(n);
+	accumulated_delta_range_meter.reserve(n);
+	carrier_frequency_hz.reserve(n);
+	constellation_type.reserve(n);
+	sys.reserve(n);
+	frq.reserve(n);
+}
+
+// Remove all rows; the storage is kept for reuse
+void obs_table::clear()
+{
+	erase_front(size());
+}
+
+// Remove the first n rows, e.g. an epoch that has been converted
+void obs_table::erase_front(size_t n)
+{
+	time_nano.erase(time_nano.begin(), time_nano.begin() + n);
+	full_bias_nano.erase(full_bias_nano.begin(), full_bias_nano.begin() + n);
+	bias_nano.erase(bias_nano.begin(), bias_nano.begin() + n);
+	hardware_clock_discountinuity_count.erase(hardware_clock_discountinuity_count.begin(), hardware_clock_discountinuity_count.begin() + n);
+	svid.erase(svid.begin(), svid.begin() + n);
+	time_offset_nano.erase(time_offset_nano.begin(), time_offset_nano.begin() + n);
+	state.erase(state.begin(), state.begin() + n);
+	received_sv_time_nano.erase(received_sv_time_nano.begin(), received_sv_time_nano.begin() + n);
+	received_sv_time_uncertainty_nano.erase(received_sv_time_uncertainty_nano.begin(), received_sv_time_uncertainty_nano.begin() + n);
+	cn0_dbhz.erase(cn0_dbhz.begin(), cn0_dbhz.begin() + n);
+	pseudorange_rate_meter_per_second.erase(pseudorange_rate_meter_per_second.begin(), pseudorange_rate_meter_per_second.begin() + n);
+	pseudorange_rate_uncertainty_meter_per_second.erase(pseudorange_rate_uncertainty_meter_per_second.begin(), pseudorange_rate_uncertainty_meter_per_second.begin() + n);
+	accumulated_delta_range_state.erase(accumulated_delta_range_state.begin(), accumulated_delta_range_state.begin() + n);
+	accumulated_delta_range_meter.erase(accumulated_delta_range_meter.begin(), accumulated_delta_range_meter.begin() + n);
+	carrier_frequency_hz.erase(carrier_frequency_hz.begin(), carrier_frequency_hz.begin() + n);
+	constellation_type.erase(constellation_type.begin(), constellation_type.begin() + n);
+	sys.erase(sys.begin(), sys.begin() + n);
+	frq.erase(frq.begin(), frq.begin() + n);
+}
@@ -0,0 +1,72 @@
+/*
+// Columnar store of GnssLogger Raw observations.
+// Every field the conversion reads is kept in its own contiguous array, so the
+// conversion loop streams through memory. The other columns of the log (drift,
+// clock and ADR uncertainties, carrier cycles and phase, multipath, SNR, AGC)
+// are skipped by the parser and never stored.
+*/
+#ifndef OBS_TABLE_H
+#define OBS_TABLE_H
+
+#include <vector>
+#include <stddef.h>
+
+#include "gnss_time.h"
+
+// Full cycle time of measurement, in whole milliseconds of GPS time; rows with
+// the same value belong to the same epoch
+inline long long rx_millis(long long time_nano, long long full_bias_nano)
+{
+	return gnss_millis(gnss_rx_time(time_nano, full_bias_nano));
+}
+
+// Receiver clock columns of a Raw row, and its constellation and carrier
+// frequency: enough to select the row before the rest of it is parsed
+struct raw_head
+{
+	long long time_nano;
+	long long full_bias_nano;
+	double    bias_nano;
+	int       hardware_clock_discountinuity_count;
+	int       constellation_type;
+	double    carrier_frequency_hz;
+};
+
+bool read_raw_head(const char* str, const char* end, raw_head* h, bool signal);
+
+struct obs_table
+{
+	// Receiver clock
+	std::vector<long long> time_nano;
+	std::vector<long long> full_bias_nano;
+	std::vector<double>    bias_nano;
+	std::vector<int>       hardware_clock_discountinuity_count;
+
+	// Measurements
+	std::vector<int>       svid;
+	std::vector<double>    time_offset_nano;
+	std::vector<int>       state;
+	std::vector<long long> received_sv_time_nano;
+	std::vector<long long> received_sv_time_uncertainty_nano;
+	std::vector<double>    cn0_dbhz;
+	std::vector<double>    pseudorange_rate_meter_per_second;
+	std::vector<double>    pseudorange_rate_uncertainty_meter_per_second;
+	std::vector<int>       accumulated_delta_range_state;
+	std::vector<double>    accumulated_delta_range_meter;
+	std::vector<double>    carrier_frequency_hz;
+	std::vector<unsigned char> constellation_type;
+
+	// Signal classification (classify_signal)
+	std::vector<unsigned char> sys;      /* SYS_*, 0 if the signal is not supported */
+	std::vector<signed char>   frq;      /* Index in the signal table, -1 if not classified */
+
+	size_t size() const { return time_nano.size(); }
+	long long rx_millis(size_t i) const { return ::rx_millis(time_nano[i], full_bias_nano[i]); }
+
+	bool add_row(const char* str, const char* end);
+	void reserve(size_t n);
+	void clear();
+	void erase_front(size_t n);
+};
+
+#endif
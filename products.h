@@ -0,0 +1,123 @@
+/*
+// Outputs made from the same pass over a log as the observation file: a RINEX 3
+// navigation file with the ephemerides decoded from the Nav records, and a CSV
+// file of the positions of the Fix records. The reader hands each line that is
+// not a Raw row to conv_other_line(), which passes it to the product asked for;
+// every product has a writer of its own (rnx_write.h), so the log is read once.
+//
+// Navigation messages decoded (GnssNavigationMessage types): GPS and QZSS L1 C/A
+// LNAV subframes 1-3, parity checked, and Galileo I/NAV words 1-5, CRC checked.
+// The ephemerides are written when the log ends, by system, satellite and time.
+*/
+#ifndef PRODUCTS_H
+#define PRODUCTS_H
+
+#include <vector>
+#include <stddef.h>
+
+#include "rnx_write.h"
+
+#define PROD_NAV      0x01              /* RINEX navigation file (.YYp) */
+#define PROD_FIX      0x02              /* Positions of the Fix records (.fix.csv) */
+
+#define NAV_GPS_L1CA  0x0101            /* Types of the Nav records decoded */
+#define NAV_QZS_L1CA  0x0401
+#define NAV_GAL_INAV  0x0601
+
+#define NAV_GPS_BYTES 40                /* Subframe: 10 words of 30 bits, each in the low bits of 4 bytes */
+#define NAV_GAL_BYTES 29                /* Even and odd page parts, 2 x 114 bits */
+#define NAV_MAX_PRN   64                /* Satellites of each system with a decoder */
+#define NAV_NSYS      3                 /* GPS, QZSS, Galileo */
+
+#define NAV_VER "     3.04           N: GNSS NAV DATA    M: Mixed            RINEX VERSION / TYPE"
+
+// Broadcast ephemeris, in the units of the RINEX navigation record
+struct nav_eph
+{
+	char   sys;                 /* RINEX system letter */
+	int    prn;
+	int    iode, iodc;          /* Galileo: IODnav in iode */
+	int    week;                /* Week of the transmission time; GPS and QZSS: 10 bits until nav_finish() */
+	double ttr, toc, toe;       /* Transmission time, clock and ephemeris reference times (s of week) */
+	double f0, f1, f2;          /* Clock bias (s), drift (s/s), drift rate (s/s^2) */
+	double crs, deln, m0, cuc, e, cus, sqrt_a, cic, omg0, cis, i0, crc, omg, omgd, idot;
+	double accuracy;            /* URA or SISA (m) */
+	int    svh;                 /* Health bits as in RINEX */
+	int    code;                /* GPS: codes on L2; Galileo: data sources */
+	int    flag;                /* GPS: L2 P data flag */
+	double fit;                 /* GPS: fit interval (h); QZSS: fit interval flag */
+	double tgd[2];              /* GPS: TGD; Galileo: BGD E5a/E1 and E5b/E1 (s) */
+};
+
+// Messages of a satellite received so far, until they make an ephemeris
+struct nav_sat
+{
+	unsigned char sub[3][30];   /* GPS, QZSS: subframes 1-3, 10 words of 24 data bits */
+	unsigned char word[5][16];  /* Galileo: words 1-5, 128 bits */
+	unsigned have;              /* Bit k: subframe or word k+1 received */
+	int last;                   /* Last ephemeris of the satellite in nav_conv::ephs, -1 if none */
+
+	nav_sat() : have(0), last(-1) {}
+};
+
+// Navigation file of a log
+struct nav_conv
+{
+	const char* log;            /* Input log, named in the messages */
+	const char* outfile;        /* Output name of the observations; the extension is replaced by .YYp */
+	int format;                 /* RNX_FMT_GZ or 0 */
+	int col_svid, col_type, col_data; /* Columns of a Nav record after its tag (from "# Nav,") */
+	std::vector<nav_sat> sats;  /* NAV_NSYS x NAV_MAX_PRN */
+	std::vector<nav_eph> ephs;
+	unsigned long long records; /* Nav records read */
+	unsigned long long rejected;/* Records of the types decoded that failed their parity or CRC */
+
+	nav_conv(const char* input, const char* file, int fmt)
+	{
+		log = input;
+		outfile = file;
+		format = fmt;
+		col_svid = 0;
+		col_type = 1;
+		col_data = 5;
+		sats.resize(NAV_NSYS * NAV_MAX_PRN);
+		records = rejected = 0;
+	}
+};
+
+void nav_columns(nav_conv* nav, const char* line, size_t len);
+void nav_line(nav_conv* nav, const char* line, size_t len);
+bool nav_finish(nav_conv* nav, long long gps_millis, bool quiet);
+
+// Output fields of the Fix CSV file
+#define FIX_TIME      0
+#define FIX_PROVIDER  1
+#define FIX_LAT       2
+#define FIX_LON       3
+#define FIX_ALT       4
+#define FIX_SPEED     5
+#define FIX_ACC       6
+#define FIX_BEARING   7
+#define FIX_VACC      8
+#define FIX_NCOL      9
+
+// Fix CSV file of a log, written as the records are read
+struct fix_conv
+{
+	const char* log;            /* Input log, named in the messages */
+	const char* outfile;        /* Output name of the observations; the extension is replaced by .fix.csv */
+	int format;                 /* RNX_FMT_GZ or 0 */
+	int col[FIX_NCOL];          /* Column of each field in a Fix record after its tag, -1 if none */
+	FILE* fp;
+	rnx_writer out;             /* Open once the first record is read */
+	bool failed;
+	unsigned long long fixes;
+
+	fix_conv(const char* input, const char* file, int fmt);
+};
+
+void fix_columns(fix_conv* fix, const char* line, size_t len);
+void fix_line(fix_conv* fix, const char* line, size_t len);
+bool fix_finish(fix_conv* fix, bool quiet);
+
+#endif
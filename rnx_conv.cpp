@@ -0,0 +1,818 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <utility>
+#include <stdio.h>
+#include <time.h>
+#include <string.h> 
+#include <stdlib.h>
+#include <math.h>
+#include <cmath>
+#include <chrono>
+
+#include "rnx_conv.h"
+#include "epoch_index.h"
+#include "products.h"
+
+char sys_code[RNX_NSYS] = { 'G', 'R', 'E', 'C', 'J', 'I' };
+int sys_code_function(int sys)
+{
+	int sys_n=-1;
+	if (sys == 1) sys_n = 0;
+	if (sys == 3) sys_n = 1;
+	if (sys == 6) sys_n = 2;
+	if (sys == 5) sys_n = 3;
+	if (sys == 4) sys_n = 4;
+	if (sys == 7) sys_n = 5;
+	return sys_n;
+}
+
+// File name part of a path
+const char* path_basename(const char* path)
+{
+	const char* base = path;
+	for (const char* p = path; *p; p++) {
+		if (*p == '/' || *p == '\\' || *p == ':') base = p + 1;
+	}
+	return base;
+}
+
+// Register a signal of sig_table and return its index in the system's signal list
+int add_signal(signal_set* ss, int sig)
+{
+	if (ss->frq[sig] >= 0) return ss->frq[sig];
+
+	int sys_n = sys_code_function(sig_table[sig].sys);
+	int n = ss->nsignals[sys_n]++;
+	ss->sig[sys_n][n] = (signed char)sig;
+	ss->frq[sig] = (signed char)n;
+	return n;
+}
+
+// Format the RINEX header into buf (RNX_HEADER_MAX bytes). The SYS / # / OBS TYPES
+// records depend on the signals found in the whole log, so RNX_SYS_LINES lines are
+// reserved for them; the header is written again, with the same length, each time
+// the file is flushed and once the last epoch has been written.
+size_t print_rnx_header(char* buf, const signal_set* ss)
+{
+	char* p = buf;
+	p += sprintf(p, "%s\n", RNX_VER);
+	p += sprintf(p, "%s\n", RNX_PGM);
+	p += sprintf(p, "%s\n", RNX_APP);
+	p += sprintf(p, "%s\n", RNX_ANT);
+
+	// Signal types: C, L, D and S of each signal, 13 per line
+	int nline = 0;
+	for (int i = 0; i < RNX_NSYS; i++)
+	{
+		int ntype = ss->nsignals[i] * 4;
+		if (ntype == 0) continue;
+
+		char body[64];
+		char* q = body + sprintf(body, "%c  %3d", sys_code[i], ntype);
+		for (int k = 0; k < ntype; k++)
+		{
+			if (k > 0 && k % 13 == 0) {
+				p += sprintf(p, "%-60s%-20s\n", body, "SYS / # / OBS TYPES");
+				nline++;
+				q = body + sprintf(body, "      ");
+			}
+			q += sprintf(q, " %c%s", "CLDS"[k % 4], sig_table[ss->sig[i][k / 4]].code);
+		}
+		p += sprintf(p, "%-60s%-20s\n", body, "SYS / # / OBS TYPES");
+		nline++;
+	}
+	for (; nline < RNX_SYS_LINES; nline++)
+		p += sprintf(p, "%s\n", RNX_COM);
+
+	p += sprintf(p, "%s\n", RNX_END);
+	return p - buf;
+}
+
+// Name of an output file: the output name with its extension, from the first
+// '.' of the file name on, replaced by ext
+std::string output_name(const char* outfile, const char* ext)
+{
+	std::string name(outfile);
+	size_t base = (size_t)(path_basename(outfile) - outfile);
+	size_t dot = name.find('.', base);
+	if (dot != std::string::npos) name.erase(dot);
+	return name + ext;
+}
+
+// Open the RINEX file (output); the extension of the file name is replaced by
+// .YYo, where YY is the year of the first epoch (.YYd for Compact RINEX, and
+// .gz appended for gzip)
+FILE* open_rnx_file(const char* outfile, const rnx_epoch* first, int format)
+{
+	char ext[24] = "";
+	snprintf(ext, sizeof(ext), ".%02d%c%s", (int)first->time[0] - 2000, (format & RNX_FMT_CRX) ? 'd' : 'o',
+		(format & RNX_FMT_GZ) ? ".gz" : "");
+
+	return fopen(output_name(outfile, ext).c_str(), (format & RNX_FMT_GZ) ? "wb" : "w");
+}
+
+// Empty an epoch for reuse; the satellite storage is kept for the next one
+void clear_rnx_epoch(rnx_epoch* e)
+{
+	memset(e->time, 0, sizeof(double) * 6);
+	e->sv = 0;
+	e->rx_millis = 0;
+	e->sats.clear();
+}
+
+// Entry of a satellite in the table of conv, NULL if its PRN is out of range
+sat_state* find_sat_state(rnx_conv* conv, int sys, int prn)
+{
+	int sys_n = sys_code_function(sys);
+	if (sys_n < 0 || prn < 0 || prn >= MAX_PRN) return NULL;
+	return &conv->sat_tab[sys_n * MAX_PRN + prn];
+}
+
+// Check and correct 4 ms delay/advance for Galileo (E1 and E5a) against the previous epoch
+void correct_gal_4ms(rnx_conv* conv, rnx_epoch& repoch)
+{
+	for (int j = 0; j < repoch.sv; j++) {
+		rnx_sat& sat = repoch.sats[j];
+		if (sat.sys != SYS_GAL) continue;
+
+		const sat_state* pre = find_sat_state(conv, sat.sys, sat.prn);
+		if (!pre || pre->epoch != conv->nepoch - 1) continue; /* Not in the previous epoch */
+
+		if (sat.p[0] != 0 && pre->p[0] != 0 && (fabs(sat.p[0] - pre->p[0] - 0.004 * CLIGHT) < 1500|| fabs(sat.p[0] - pre->p[0] + 0.004 * CLIGHT) < 1500)) {
+			int sign = (sat.p[0]  - pre->p[0]) < 0 ? -1 : 1;
+			sat.p[0] = sat.p[0] - sign * 0.004 * CLIGHT;
+		}
+		if (sat.p[1] != 0 && pre->p[1] != 0 && (fabs(sat.p[1] - pre->p[1] - 0.004 * CLIGHT) < 1500 || fabs(sat.p[1] - pre->p[1] + 0.004 * CLIGHT) < 1500)) {
+			int sign = (sat.p[1]  - pre->p[1]) < 0 ? -1 : 1;
+			sat.p[1] = sat.p[1] - sign * 0.004 * CLIGHT;
+		}
+	}
+}
+
+// Detach the satellites of the current epoch from the table; when the epoch was
+// written, keep its measurements as the satellites' previous epoch
+static void release_sats(rnx_conv* conv, bool written)
+{
+	rnx_epoch& repoch = conv->repoch;
+	for (int j = 0; j < repoch.sv; j++) {
+		sat_state* st = find_sat_state(conv, repoch.sats[j].sys, repoch.sats[j].prn);
+		if (!st) continue;
+		st->slot = -1;
+		if (!written) continue;
+		st->epoch = conv->nepoch;
+		memcpy(st->p, repoch.sats[j].p, sizeof(st->p));
+		memcpy(st->l, repoch.sats[j].l, sizeof(st->l));
+		memcpy(st->lli, repoch.sats[j].lli, sizeof(st->lli));
+	}
+}
+
+// Calendar date of a day counted from the GPS epoch (1980-01-06), in closed form
+// (proleptic Gregorian calendar, valid for any date)
+void gpsday2ymd(long long day, int *ymd)
+{
+	long long z = day + 3657 + 719468;             /* Days since 0000-03-01 */
+	long long era = (z >= 0 ? z : z - 146096) / 146097;
+	long long doe = z - era * 146097;              /* Day of the 400-year era [0, 146096] */
+	long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100); /* Day of the year from March 1 */
+	long long mp = (5 * doy + 2) / 153;
+	int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+
+	ymd[0] = (int)(yoe + era * 400 + (month <= 2));
+	ymd[1] = month;
+	ymd[2] = (int)(doy - (153 * mp + 2) / 5 + 1);
+}
+
+// Day counted from the GPS epoch of a calendar date, the inverse of gpsday2ymd
+long long ymd2gpsday(int y, int m, int d)
+{
+	long long yy = y - (m <= 2);                   /* Years from March 1 */
+	long long era = (yy >= 0 ? yy : yy - 399) / 400;
+	long long yoe = yy - era * 400;
+	long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468 - 3657;
+}
+
+// Function to compute GPS time from time_nano full_bias_nano and bias_nano.
+// The date of the last day converted is kept in cache, if given, so that the
+// epochs of the same day only split the seconds of the day.
+void  gpstime2ymdhms(long long *time_nano, long long *full_bias_nano, double *bias_nano,double *time, gps_day* cache) {
+
+	// This the formula to compute the GPS time: GPS time = time Nano - (fullbiasnano + biasnano)[ns]
+	gnss_time   gps_time        = gnss_rx_time(*time_nano, *full_bias_nano); //in ns, without biasnano
+	long long   tod_nano        = gnss_tod(gps_time);                         //since midnight
+	double      delta_time_frac = ((double)(tod_nano % SEC_NANO) - *bias_nano) / 1e9; //fractional part 
+	
+	const int HOURSEC = 3600, MINSEC = 60; /* Number of seconds in an hour and in a minute*/
+
+	long long day = gnss_day(gps_time); //days since 1980 / 1 / 6
+	int ymd[3];
+	if (cache && cache->day == day) {
+		memcpy(ymd, cache->ymd, sizeof(ymd));
+	}
+	else {
+		gpsday2ymd(day, ymd);
+		if (cache) {
+			cache->day = day;
+			memcpy(cache->ymd, ymd, sizeof(ymd));
+		}
+	}
+	time[0] = ymd[0];
+	time[1] = ymd[1];
+	time[2] = ymd[2];
+	
+	int sinceMidnightSeconds = (int)(tod_nano / SEC_NANO);
+	time[3] = sinceMidnightSeconds/HOURSEC;
+	
+	int lastHourSeconds = sinceMidnightSeconds%HOURSEC;
+	time[4] = lastHourSeconds/MINSEC;
+	time[5] = (lastHourSeconds%MINSEC)+ delta_time_frac;
+}
+
+// Find the constellation and signal type of observation i, and snap its carrier
+// frequency to the nominal one of the signal (FDMA: to 100 Hz)
+void classify_signal(signal_set* ss, obs_table* t, size_t i)
+{
+	int cons = t->constellation_type[i];
+	if (cons == SYS_QZS) t->svid[i] -= 192;
+
+	int sig = lookup_signal(cons, t->carrier_frequency_hz[i]);
+	if (sig < 0) return;
+
+	const sig_def* d = &sig_table[sig];
+	t->sys[i] = (unsigned char)d->sys;
+	t->frq[i] = (signed char)add_signal(ss, sig);
+	t->carrier_frequency_hz[i] = d->freq > 0.0 ? d->freq : round(t->carrier_frequency_hz[i] / 1e2) * 1e2;
+}
+
+// Register every signal that classify_signal() can find, in the order of sig_table.
+// Compact RINEX decodes each data line with the observation types of the header,
+// so its output lists them all from the first epoch on instead of as they appear.
+void add_known_signals(signal_set* ss)
+{
+	for (int k = 0; k < SIG_COUNT; k++) add_signal(ss, k);
+}
+
+// Write the header for the signals found so far; the first call starts the file
+static void write_header(rnx_conv* conv)
+{
+	char header[RNX_HEADER_MAX];
+	size_t len = print_rnx_header(header, &conv->sigs);
+	if (!rnx_writer_header(&conv->out, header, len)) conv->failed = true;
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Statistics index of a system: sys_code order, the last one for the others
+static int stat_sys(int sys)
+{
+	int sys_n = sys_code_function(sys);
+	return sys_n >= 0 ? sys_n : STAT_SYS - 1;
+}
+
+// Print a warning of the given kind, at most WARN_MAX times; the others are only
+// counted and reported by conv_finish(). Chunks of the parallel path only count.
+static void conv_warn(rnx_conv* conv, int kind, const char* msg)
+{
+	conv->stats.warnings[kind]++;
+	if (conv->collect || conv->quiet || conv->warned[kind] >= WARN_MAX) return;
+	printf("%s\n", msg);
+	if (++conv->warned[kind] == WARN_MAX) printf("(further warnings of this kind are counted, not shown)\n");
+}
+
+// Hand the epochs written so far to the file, with the header completed for the
+// signals seen so far, so that the file can be read while the log is converted
+void conv_flush(rnx_conv* conv)
+{
+	if (!conv->out.buf || conv->failed) return;
+	write_header(conv);
+	if (!rnx_writer_sync(&conv->out)) conv->failed = true;
+}
+
+// Write an epoch, opening the RINEX file (or the stream) and its header on the first one
+void write_epoch(rnx_conv* conv, const rnx_epoch& e)
+{
+	if (conv->failed) return;
+	if (!conv->out.buf && conv->out_fn) {
+		if (!rnx_writer_open_stream(&conv->out, conv->out_fn, conv->out_user, conv->format)) {
+			conv->failed = true;
+			return;
+		}
+		write_header(conv);
+	}
+	else if (!conv->out.buf) {
+		conv->fpw = open_rnx_file(conv->outfile, &e, conv->format);
+		if (!conv->fpw) {
+			conv->failed = true;
+			return;
+		}
+		if (!rnx_writer_open(&conv->out, conv->fpw, conv->format) ||
+			(conv->pipeline && !rnx_writer_start_thread(&conv->out))) {
+			conv->failed = true;
+			return;
+		}
+		write_header(conv);
+	}
+	if (e.sv > 0) {
+		auto t0 = std::chrono::steady_clock::now();
+		print_rnx_epoch(&conv->out, &conv->sigs, e);
+		if (conv->out.failed) conv->failed = true;
+		conv->stats.epochs++;
+		conv->stats.t_write += elapsed_s(t0);
+	}
+}
+
+// Close the current epoch at an epoch boundary: apply the Galileo check, write it
+// and keep its measurements for the next one
+void close_epoch(rnx_conv* conv, long long allRxMillis)
+{
+	rnx_epoch& repoch = conv->repoch;
+
+	if (conv->collect) {
+		release_sats(conv, false);
+		repoch.rx_millis = conv->allRxMillis_p;
+		conv->collect->push_back(std::move(repoch));
+		clear_rnx_epoch(&repoch);
+		return;
+	}
+
+	long long gap = allRxMillis - conv->allRxMillis_p; /* ms */
+	if (conv->nepoch > 0 && repoch.sv > 0 && gap >= 500 && gap < 1500) {
+		correct_gal_4ms(conv, repoch);
+	}
+
+	// An epoch off the decimation grid only holds the Galileo pseudoranges for the check
+	if (!conv->skip) {
+		write_epoch(conv, repoch);
+		if (repoch.sv <= 4) {
+			conv_warn(conv, WARN_SPARSE, "Warning: Number of satellites is less than 4 in this epoch ");
+		}
+	}
+
+	release_sats(conv, true);
+	conv->nepoch++;
+	clear_rnx_epoch(&repoch);
+
+	if (!conv->skip && conv->flush_epochs > 0 && conv->nepoch % conv->flush_epochs == 0) {
+		conv_flush(conv);
+	}
+}
+
+// Start a new epoch at row i of t: close the current epoch and, after a hardware
+// clock discontinuity, take row i as the new reference epoch
+void start_epoch(rnx_conv* conv, const obs_table* t, size_t i)
+{
+	long long allRxMillis = t->rx_millis(i);
+
+	close_epoch(conv, allRxMillis);
+	conv->allRxMillis_p = allRxMillis;
+	int check_clkdisc = t->hardware_clock_discountinuity_count[i];
+	if (check_clkdisc != conv->check_clkdiscp) {
+		conv->check_clkdiscp = check_clkdisc;
+		conv->ref_full_bias_nano = t->full_bias_nano[i];
+		conv->ref_bias_nano = t->bias_nano[i];
+	}
+}
+
+// Check row i of t and add it to conv->batch; the reason it is rejected (REJ_*), or -1
+static int batch_row(rnx_conv* conv, const obs_table* t, size_t i)
+{
+	int frq = t->frq[i];
+	if (t->sys[i] == 0 || frq == -1) {
+		return REJ_SIGNAL; /* Reject constellations and signals that are not supported */
+	}
+
+	bool available = false;
+	
+	if (t->sys[i] == SYS_GPS || t->sys[i] == SYS_BDS || t->sys[i] == SYS_QZS || t->sys[i] == SYS_IRN)
+	{
+		available = t->state[i]&STATE_CODE_LOCK && t->state[i]&STATE_TOW_DECODED;
+		/*if (round(t->carrier_frequency_hz[i] / 1e4) == 117645) {
+			available = t->state[i] & STATE_CODE_LOCK;
+		}*/
+	}
+	else if (t->sys[i] == SYS_GLO)
+	{
+		available = t->state[i]&STATE_GLO_STRING_SYNC && t->state[i]&STATE_GLO_TOD_KNOWN;
+	}
+	else if (t->sys[i] == SYS_GAL)
+	{
+     	available =((t->state[i] & STATE_GAL_E1C_2ND_CODE_LOCK) || ((t->state[i] & STATE_TOW_DECODED)));
+	
+		/*if (round(t->carrier_frequency_hz[i] / 1e4) == 117645) {
+			available = t->state[i] & STATE_TOW_DECODED;
+		}*/
+	}
+
+	if (!available) {
+		return REJ_STATE; /* Reject bad observations with invalid state */
+	}
+
+	if (t->pseudorange_rate_uncertainty_meter_per_second[i]> MAXPRRUNCMPS || t->received_sv_time_uncertainty_nano[i]>MAXTOWUNCNS) {
+		return REJ_UNC; /* Reject bad observations */
+	}
+
+	// https://www.gsa.europa.eu/system/files/reports/gnss_raw_measurement_web_0.pdf pp.21-22
+	gnss_time rx_time = gnss_rx_time(t->time_nano[i], conv->ref_full_bias_nano) + (long long)t->time_offset_nano[i];
+	long long send_nano = t->received_sv_time_nano[i]; /* Time of transmission in ns */
+	long long receive_nano = 0;                        /* Time of reception in ns, on the same scale */
+	long long period = WEEK_NANO;
+
+	switch (t->sys[i])
+	{
+	case SYS_GLO:
+		receive_nano = glo_tod(rx_time, LeapSecond);
+		period = DAY_NANO;
+		break;
+	case SYS_BDS:
+		receive_nano = bds_tow(rx_time);
+		break;
+	default: /* GPS, Galileo, QZSS; NavIC time of week is that of GPS */
+		receive_nano = gps_tow(rx_time);
+		break;
+	}
+
+	/* Time of reception minus time of transmission in ns. A week (GLONASS: day)
+	   rollover between them is removed here, in integer ns, where it is exact;
+	   converted to seconds first, a whole day would leave the pseudorange with a
+	   resolution of several mm. */
+	long long dt_nano = fold_period(receive_nano - send_nano, period);
+	if (dt_nano != receive_nano - send_nano) {
+		/* Check that common bias is not huge(like, bigger than 10s) */
+		long long maxBiasNano = 10 * SEC_NANO;
+		if (dt_nano > maxBiasNano) conv_warn(conv, WARN_ROLLOVER, "Failed to correct week rollover");
+		else conv_warn(conv, WARN_ROLLOVER, "Week rollover detected and corrected ");
+	}
+	conv->batch.push(i, (double)dt_nano, t->pseudorange_rate_meter_per_second[i],
+		t->accumulated_delta_range_meter[i], t->carrier_frequency_hz[i]);
+	return -1;
+}
+
+// Compute the observables of the classified rows [i0,i1) of t into the current epoch.
+// The rows that pass the quality checks are gathered into conv->batch, whose
+// observables are computed together (obs_kernel.h), then stored per satellite.
+void conv_rows(rnx_conv* conv, const obs_table* t, size_t i0, size_t i1)
+{
+	rnx_epoch& repoch = conv->repoch;
+	conv_stats* stats = &conv->stats;
+	obs_batch* b = &conv->batch;
+	if (i0 >= i1) return;
+	auto t0 = std::chrono::steady_clock::now();
+	b->clear();
+
+	// The rows of an epoch share its receiver time; the epoch is stamped with the last one
+	long long time_nano = t->time_nano[i1 - 1];
+	gpstime2ymdhms(&time_nano, &conv->ref_full_bias_nano, &conv->ref_bias_nano, repoch.time, &conv->day);
+
+	for (size_t i = i0; i < i1; i++)
+	{
+		if (conv->skip) {
+			/* Epoch left out by the decimation: its slips are kept for the next epoch
+			   written, its Galileo pseudoranges for the 4 ms check */
+			sat_state* st = t->frq[i] >= 0 ? find_sat_state(conv, t->sys[i], t->svid[i]) : NULL;
+			if (st && (t->accumulated_delta_range_state[i] & (GPS_ADR_STATE_CYCLE_SLIP | GPS_ADR_STATE_RESET))) st->slip[t->frq[i]] = true;
+			if (t->sys[i] == SYS_GAL) batch_row(conv, t, i);
+			stats->skipped++;
+			continue;
+		}
+		int sn = stat_sys(t->constellation_type[i]); /* SYS_* match the constellation types */
+		stats->rows++;
+		stats->rows_sys[sn]++;
+
+		int rej = batch_row(conv, t, i);
+		if (rej >= 0) stats->rejected[rej][sn]++;
+	}
+
+	/* pr_second, the time of reception minus the time of transmission in seconds, and the observables */
+	compute_obs(b, conv->ref_bias_nano);
+
+	for (size_t k = 0; k < b->size(); k++)
+	{
+		size_t i = b->row[k];
+		int sn = stat_sys(t->constellation_type[i]);
+		int frq = t->frq[i];
+		double pr_second = b->pr_second[k];
+
+		if (pr_second > 0.5|| pr_second <0) {
+			if (!conv->skip) stats->rejected[REJ_RANGE][sn]++;
+			continue;
+		}
+		if (t->sys[i] == SYS_GLO && t->svid[i] > 80) { stats->rejected[REJ_GLO_SLOT][sn]++; continue;} // Delete some odd GLONASS numbers larger than 80 
+	
+		rnx_sat* sat = NULL;
+		sat_state* st = find_sat_state(conv, t->sys[i], t->svid[i]);
+		if (st)
+		{
+			if (st->slot >= 0) sat = &repoch.sats[st->slot];
+		}
+		else
+		{
+			for (int j = 0; j < repoch.sv; j++) /* PRN outside the table */
+			{
+				if (repoch.sats[j].sys == t->sys[i] &&
+					repoch.sats[j].prn == t->svid[i])
+				{
+					sat = &repoch.sats[j];
+					break;
+				}
+			}
+		}
+
+		if (!sat)
+		{
+			if (st) st->slot = repoch.sv;
+			repoch.sats.push_back(rnx_sat());
+			repoch.sv++;
+			sat = &repoch.sats.back();
+
+			sat->sys = t->sys[i];
+			sat->prn = t->svid[i];
+		}
+
+		sat->p[frq] = b->p[k];            // Pseudorange measurement
+		if (conv->skip) continue;         /* Off the decimation grid: only the pseudorange is kept */
+		sat->d[frq] = b->d[k];            // Doppler measurement
+		sat->l[frq] = b->l[k];            // Carrier-phase measurement
+		sat->s[frq] = t->cn0_dbhz[i];     // C/N0 measurement
+		
+		if (t->accumulated_delta_range_state[i]& GPS_ADR_STATE_UNKNOWN) {
+			sat->l[frq] = 0;
+		}
+
+		if ((t->accumulated_delta_range_state[i] & GPS_ADR_STATE_HALF_CYCLE_REPORTED) && !(t->accumulated_delta_range_state[i] & GPS_ADR_STATE_HALF_CYCLE_RESOLVED)) {
+			sat->lli[frq] = LLI_HALFC;
+		}
+		if ((t->accumulated_delta_range_state[i] & GPS_ADR_STATE_CYCLE_SLIP) || (st && st->slip[frq])) {
+			sat->lli[frq] = LLI_SLIP;     /* Also for a slip in the epochs left out since the last one */
+		}
+		if (st) st->slip[frq] = false;
+		stats->obs[sn][frq]++;
+	}
+	stats->t_convert += elapsed_s(t0);
+}
+
+// Take the row just added to conv->rows into its epoch. Rows are collected
+// until the epoch is complete, then converted together.
+void conv_row(rnx_conv* conv)
+{
+	obs_table* t = &conv->rows;
+	size_t n = t->size() - 1;
+
+	if (conv->first) {
+		conv->first = false;
+		conv->allRxMillis_p = t->rx_millis(n);
+		if (!conv->clock_ref || t->hardware_clock_discountinuity_count[n] != conv->check_clkdiscp) {
+			conv->check_clkdiscp = t->hardware_clock_discountinuity_count[n];
+			conv->ref_full_bias_nano = t->full_bias_nano[n];
+			conv->ref_bias_nano = t->bias_nano[n];
+		}
+		conv->skip = off_grid(conv, t, n);
+	}
+
+	// Anything within 1ms is considered same epoch :
+	if (t->rx_millis(n) != conv->allRxMillis_p) {
+		if (conv->cache.fp) obc_end_epoch(&conv->cache);
+		conv_rows(conv, t, 0, n);
+		start_epoch(conv, t, n);
+		conv->skip = off_grid(conv, t, n);
+		t->erase_front(n);
+		n = 0;
+	}
+	if (conv->cache.fp) obc_add_row(&conv->cache, t, n);
+
+	// Signals are collected as they appear, so an epoch lists the signals seen up to its end
+	classify_signal(&conv->sigs, t, n);
+}
+
+// Convert one Raw line
+void conv_line(rnx_conv* conv, const char* line, size_t len)
+{
+	if (conv->selective) {
+		raw_head h;
+		if (conv->done || !read_raw_head(line, line + len, &h, conv->sig_mask != 0) || !select_row(conv, &h)) return;
+	}
+	if (!conv->rows.add_row(line, line + len)) return;
+	conv_row(conv);
+}
+
+// Save the rows of this conversion to a cache file named after the output (.obc)
+bool open_cache_file(rnx_conv* conv)
+{
+	std::string name = output_name(conv->outfile, ".obc");
+	if (obc_open(&conv->cache, name.c_str())) return true;
+	fprintf(stderr, "Cannot create the cache file %s\n", name.c_str());
+	return false;
+}
+
+// Make the products asked for along with the observations (products.h)
+void open_products(rnx_conv* conv, const conv_opt* opt, const char* infile)
+{
+	if (!opt) return;
+	int gz = opt->format & RNX_FMT_GZ;
+	if (opt->products & PROD_NAV) conv->nav = new nav_conv(infile, conv->outfile, gz);
+	if (opt->products & PROD_FIX) conv->fix = new fix_conv(infile, conv->outfile, gz);
+}
+
+// Hand a line other than a Raw row to the products: their records, and the
+// lines of the log header that name their columns
+void conv_other_line(rnx_conv* conv, const char* line, size_t len)
+{
+	if (conv->nav && len > 4 && memcmp(line, "Nav,", 4) == 0) nav_line(conv->nav, line, len);
+	else if (conv->fix && len > 4 && memcmp(line, "Fix,", 4) == 0) fix_line(conv->fix, line, len);
+	else if (conv->nav && len > 6 && memcmp(line, "# Nav,", 6) == 0) nav_columns(conv->nav, line + 2, len - 2);
+	else if (conv->fix && len > 6 && memcmp(line, "# Fix,", 6) == 0) fix_columns(conv->fix, line + 2, len - 2);
+}
+
+// Write and close the products; false if one of them failed
+static bool finish_products(rnx_conv* conv)
+{
+	bool ok = true;
+	if (conv->nav) {
+		conv->stats.nav_records = conv->nav->records;
+		conv->stats.ephemerides = conv->nav->ephs.size();
+		if (!nav_finish(conv->nav, conv->allRxMillis_p, conv->quiet)) ok = false;
+		delete conv->nav;
+		conv->nav = NULL;
+	}
+	if (conv->fix) {
+		conv->stats.fixes = conv->fix->fixes;
+		if (!fix_finish(conv->fix, conv->quiet)) ok = false;
+		delete conv->fix;
+		conv->fix = NULL;
+	}
+	return ok;
+}
+
+// Write the last epoch, complete the header and close the RINEX file
+bool conv_finish(rnx_conv* conv)
+{
+	conv_rows(conv, &conv->rows, 0, conv->rows.size());
+	conv->rows.clear();
+	if (!conv->first && !conv->skip) {
+		write_epoch(conv, conv->repoch);
+	}
+	bool written = conv->out.buf != NULL;    /* Not when all epochs are off the decimation grid */
+	if (conv->out.buf) {
+		if (!conv->failed) write_header(conv);
+		if (!rnx_writer_close(&conv->out)) conv->failed = true;
+		conv->stats.stalls[STALL_OUTPUT] = conv->out.put_stalls;
+		conv->stats.stalls[STALL_WRITE] = conv->out.write_stalls;
+	}
+	if (conv->fpw) {
+		fclose(conv->fpw);
+		conv->fpw = NULL;
+	}
+	if (conv->cache.fp && !obc_close(&conv->cache)) {
+		fprintf(stderr, "Writing the cache file of %s failed\n", conv->outfile);
+	}
+	if (!finish_products(conv)) conv->failed = true;
+	if (!conv->quiet && conv->stats.warnings[WARN_SPARSE] > (unsigned long long)conv->warned[WARN_SPARSE]) {
+		printf("Warning: %llu epochs with less than 4 satellites in total\n", conv->stats.warnings[WARN_SPARSE]);
+	}
+	if (!conv->quiet && conv->stats.warnings[WARN_ROLLOVER] > (unsigned long long)conv->warned[WARN_ROLLOVER]) {
+		printf("Warning: %llu observations across a week rollover in total\n", conv->stats.warnings[WARN_ROLLOVER]);
+	}
+	release_sats(conv, false);
+	clear_rnx_epoch(&conv->repoch);
+	if (conv->first && conv->selective && !conv->quiet) printf("No observations in the selected time window and signals\n");
+	else if (!written && conv->interval_nano && !conv->quiet) printf("No epochs within the tolerance of the decimation grid\n");
+	return !conv->first && written && !conv->failed;
+}
+
+// Convert the Raw lines of an open log and close the RINEX file. With products
+// the other lines go to them, and the log is read to its end past a time window.
+static bool convert_log(log_reader* rd, rnx_conv* conv, const char* infile)
+{
+	bool products = conv->nav || conv->fix;
+	const char* line = NULL;
+	size_t len = 0;
+	while (log_next_line(rd, &line, &len))
+	{
+		if (len < 4 || memcmp(line, "Raw,", 4) != 0) { /* Comments and other records */
+			if (products) conv_other_line(conv, line, len);
+			continue;
+		}
+		if (conv->done && products) continue;
+
+		conv_line(conv, line, len);
+		if (conv->failed || (conv->done && !products)) break;
+	}
+	bool read_ok = !rd->failed;
+	if (rd->cut && !conv->quiet) printf("Warning: the last line of %s is incomplete and was left out\n", infile);
+	log_pipe_stalls(rd, &conv->stats.stalls[STALL_READ], &conv->stats.stalls[STALL_PARSE]);
+	log_close(rd);
+	if (!read_ok) fprintf(stderr, "%s is corrupt or truncated; the epochs before that point are converted\n", infile);
+
+	bool ok = conv_finish(conv) && read_ok;
+	if (!ok) fprintf(stderr, "Conversion of %s failed\n", infile);
+	return ok;
+}
+
+// Convert the rows of a mapped cache file (.obc) and close the RINEX file. The
+// rows go through the same epoch grouping as the lines of a log.
+static bool convert_cache(log_reader* rd, rnx_conv* conv, const char* infile)
+{
+	bool read_ok = true;
+	size_t nblocks = obc_nblocks(rd->data);
+	for (size_t k = 0; k < nblocks && !conv->failed && !conv->done; k++) {
+		obc_block b;
+		if (!obc_get_block(rd->data, rd->size, k, &b)) {
+			read_ok = false;
+			break;
+		}
+		for (size_t i = 0; i < b.nrows && !conv->done; i++) {
+			if (conv->selective) {
+				raw_head h = { b.time_nano[i], b.full_bias_nano[i], b.bias_nano[i], b.hardware_clock_discountinuity_count[i],
+					b.constellation_type[i], b.carrier_frequency_hz[i] };
+				if (!select_row(conv, &h)) continue;
+			}
+			obc_append(&conv->rows, &b, i, i + 1);
+			conv_row(conv);
+		}
+	}
+	log_close(rd);
+	if (!read_ok) fprintf(stderr, "%s is corrupt; the epochs before that point are converted\n", infile);
+
+	bool ok = conv_finish(conv) && read_ok;
+	if (!ok) fprintf(stderr, "Conversion of %s failed\n", infile);
+	return ok;
+}
+
+// Convert one GnssLogger file, or a cache file saved by an earlier run. The file
+// is streamed epoch by epoch: each epoch is written as soon as the next one starts.
+// With opt->pipeline a text log is read and the output written on threads of their
+// own, so that the storage and the conversion work at the same time. A time
+// window starts at its first epoch when the log has an epoch index.
+bool convert_file(const char* infile, const char* outfile, const conv_opt* opt, conv_stats* stats)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	log_reader rd;
+	if (!log_open(&rd, infile)) {
+		fprintf(stderr, "Cannot open %s\n", infile);
+		return false;
+	}
+
+	rnx_conv conv(outfile, opt);
+	bool ok;
+	if (rd.mapped && obc_is_cache(rd.data, rd.size)) {
+		if (opt && opt->products) printf("%s is a cache file of Raw rows only; no navigation or Fix output\n", infile);
+		ok = convert_cache(&rd, &conv, infile);
+	}
+	else {
+		// With an epoch index, a time window is read from its first epoch on, with
+		// the reference clock in effect there. Products take the whole log.
+		unsigned long long start = 0;
+		epoch_index ix;
+		if (opt && !rd.z && !opt->products && (opt->t_start || opt->build_index) && obi_open(infile, &ix, opt->build_index)) {
+			size_t k = opt->t_start ? obi_find_time(&ix, opt->t_start) : 0;
+			if (k > 0 && k < ix.entries.size()) {
+				const obi_entry* e = &ix.entries[k];
+				start = e->offset;
+				conv.clock_ref = true;
+				conv.check_clkdiscp = e->disc;
+				conv.ref_full_bias_nano = e->ref_full_bias_nano;
+				conv.ref_bias_nano = e->ref_bias_nano;
+			}
+		}
+
+		// Pipeline: reader thread -> conversion on this thread -> writer thread
+		if (opt && opt->pipeline && !rd.z) {
+			log_close(&rd);
+			if (!log_open_pipe(&rd, infile, start)) {
+				fprintf(stderr, "Cannot open %s\n", infile);
+				return false;
+			}
+		}
+		else if (start > 0) log_seek(&rd, start);
+		if (opt && opt->cache) open_cache_file(&conv);
+		open_products(&conv, opt, infile);
+		ok = convert_log(&rd, &conv, infile);
+	}
+	take_stats(&conv, elapsed_s(t0), stats);
+	return ok;
+}
+
+// Convert a log while it is being written (growing file, FIFO, or "-" for stdin).
+// Each epoch is written as soon as the first row of the next one arrives, and the
+// RINEX file is flushed with a complete header every opt->flush_epochs epochs.
+bool convert_follow(const char* infile, const char* outfile, const conv_opt* opt, conv_stats* stats)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	log_reader rd;
+	if (!log_open_follow(&rd, infile, opt->idle_ms)) {
+		fprintf(stderr, "Cannot open %s\n", infile);
+		return false;
+	}
+
+	rnx_conv conv(outfile, opt);
+	conv.flush_epochs = opt->flush_epochs;
+	if (opt->cache) open_cache_file(&conv);
+	open_products(&conv, opt, infile);
+	bool ok = convert_log(&rd, &conv, infile);
+	take_stats(&conv, elapsed_s(t0), stats);
+	return ok;
+}
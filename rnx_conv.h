@@ -0,0 +1,400 @@
+/*
+// Conversion of GnssLogger Raw measurements to RINEX 3.04 observations:
+// observation records, signal classification, epoch grouping and output.
+*/
+#ifndef RNX_CONV_H
+#define RNX_CONV_H
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+#include "log_reader.h"
+#include "obs_table.h"
+#include "obs_cache.h"
+#include "rnx_write.h"
+#include "rnx_signals.h"
+#include "obs_kernel.h"
+
+#define CLIGHT      299792458.0         /* Speed of light (m/s) */
+#define LeapSecond      18              /* Leap seccond for 2021 */
+
+#define MAXPRRUNCMPS  10               /* Maximum pseudorange rate (Doppler) uncertainty */
+#define MAXTOWUNCNS   500              /* Maximum Tow uncertainty, 500 ns, for example */
+
+#define MAX_LINE 1024
+
+#define MAX_SYS 10
+#define MAX_FRQ 5
+#define MAX_PRN 100                     /* PRNs 0-99 of each system are direct-indexed */
+
+#define RNX_VER "     3.04           OBSERVATION DATA    M: Mixed            RINEX VERSION / TYPE"
+#define RNX_PGM "UofC CSV2RINEX convertor                                    PGM / RUN BY / DATE "
+#define RNX_APP "                                                            APPROX POSITION XYZ "
+#define RNX_ANT "        0.0000        0.0000        0.0000                  ANTENNA: DELTA H/E/N"
+#define RNX_END "                                                            END OF HEADER       "
+#define RNX_COM "                                                            COMMENT             "
+
+#define RNX_SYS_LINES rnx_sys_lines()   /* Header lines reserved for SYS / # / OBS TYPES */
+#define RNX_HEADER_MAX 4096             /* Longest RINEX header */
+
+// Refer to: https://android.googlesource.com/platform/hardware/libhardware/+/master/include/hardware/gps.h
+
+#define GPS_MEASUREMENT_STATE_UNKNOWN       0
+#define STATE_CODE_LOCK                     1//2^0  
+#define STATE_TOW_DECODED                   8//2^3
+#define STATE_TOW_KNOWN                 16384// maybe TOW not decoded but known from other sources. In contrast, if TOW is decoded then it is known
+
+#define STATE_GLO_STRING_SYNC               64//2^6
+#define STATE_GLO_TOD_KNOWN                 128//2^7
+
+#define STATE_GAL_E1C_2ND_CODE_LOCK         2048//2^11
+#define STATE_GAL_E1BC_CODE_LOCK            1024//2^10
+#define STATE_GAL_E1B_PAGE_SYNC             4096//2^12  
+
+#define GPS_ADR_STATE_UNKNOWN               0 
+#define GPS_ADR_STATE_VALID                 1//2^0
+#define GPS_ADR_STATE_RESET                 2//2^1
+#define GPS_ADR_STATE_CYCLE_SLIP            4//2^2
+#define GPS_ADR_STATE_HALF_CYCLE_RESOLVED   8//2^3
+#define GPS_ADR_STATE_HALF_CYCLE_REPORTED  16//2^4
+
+#define LLI_SLIP    0x01                /* LLI: cycle-slip */
+#define LLI_HALFC   0x02                /* LLI: half-cycle not resovled */
+#define LLI_BOCTRK  0x04                /* LLI: boc tracking of mboc signal */
+#define LLI_HALFA   0x40                /* LLI: half-cycle added */
+#define LLI_HALFS   0x80                /* LLI: half-cycle subtracted */
+
+
+struct rnx_sat
+{
+	int sys;
+	int prn;
+
+	double p[MAX_FRQ];
+	double l[MAX_FRQ];
+	double d[MAX_FRQ];
+	double s[MAX_FRQ];
+	int lli[MAX_FRQ];
+};
+
+struct rnx_epoch
+{
+	double time[6];
+	int sv;
+	long long rx_millis;          /* Receiver time of the epoch rows (ms), as used for grouping */
+
+	std::vector<rnx_sat> sats;    /* Held by value; the storage is reused from epoch to epoch */
+
+	rnx_epoch()
+	{
+		memset(time, 0, sizeof(double) * 6);
+		sv = 0;
+		rx_millis = 0;
+	}
+};
+
+// Signal types found in a log, in order of first appearance
+struct signal_set
+{
+	signed char sig[MAX_SYS][MAX_FRQ];  /* sig_table index of each signal of a system */
+	int nsignals[MAX_SYS];
+	signed char frq[SIG_COUNT];         /* Index of each sig_table signal in its system's list, -1 if not found yet */
+
+	signal_set()
+	{
+		memset(sig, -1, sizeof(sig));
+		memset(nsignals, 0, sizeof(nsignals));
+		memset(frq, -1, sizeof(frq));
+	}
+};
+
+static_assert(sys_signals(SYS_GPS) <= MAX_FRQ && sys_signals(SYS_GLO) <= MAX_FRQ && sys_signals(SYS_GAL) <= MAX_FRQ &&
+	sys_signals(SYS_BDS) <= MAX_FRQ && sys_signals(SYS_QZS) <= MAX_FRQ && sys_signals(SYS_IRN) <= MAX_FRQ,
+	"MAX_FRQ is too small for the signals of sig_table");
+
+void add_known_signals(signal_set* ss);
+
+// Satellite entry of the (system, PRN) table, kept across epochs
+struct sat_state
+{
+	int slot;                /* Index in the current epoch's sats, -1 if not in it yet */
+	int epoch;               /* Last written epoch with the satellite, -1 if none */
+	double p[MAX_FRQ];       /* Pseudoranges, phases and LLI of that epoch */
+	double l[MAX_FRQ];
+	int lli[MAX_FRQ];
+	bool slip[MAX_FRQ];      /* Cycle slip or phase reset in an epoch left out since (decimation) */
+
+	sat_state()
+	{
+		slot = -1;
+		epoch = -1;
+		memset(p, 0, sizeof(p));
+		memset(l, 0, sizeof(l));
+		memset(lli, 0, sizeof(lli));
+		memset(slip, 0, sizeof(slip));
+	}
+};
+
+// Calendar date of the last GPS day converted to year, month, day
+struct gps_day
+{
+	long long day;           /* Days since the GPS epoch, -1 if none yet */
+	int ymd[3];
+
+	gps_day()
+	{
+		day = -1;
+		memset(ymd, 0, sizeof(ymd));
+	}
+};
+
+#define DECIM_TOL_MS  50                /* Default decimation tolerance, under half the epoch spacing up to 10 Hz */
+
+// Conversion options
+struct conv_opt
+{
+	int format;              /* RNX_FMT_* flags of the output */
+	int flush_epochs;        /* Follow mode: flush the file every n epochs, 0 = when the buffer is full */
+	int idle_ms;             /* Follow mode: end after this long without new data, 0 = never */
+	bool cache;              /* Also save the parsed rows to a cache file (.obc) for later runs */
+	bool pipeline;           /* Read and write the files on threads of their own (slow or network storage) */
+
+	// Selection of the rows converted (conv_filter.cpp)
+	gnss_time t_start;       /* GPS time window [t_start, t_end) of the epochs written; 0 = open */
+	gnss_time t_end;
+	unsigned  sig_mask;      /* Signals converted, bit k for sig_table[k]; 0 = all */
+	bool build_index;        /* Build the epoch index of a log (.obi) if it has none (epoch_index.h) */
+	int interval_ms;         /* Decimation: write only the epochs on a grid of this interval, 0 = all */
+	int interval_tol_ms;     /* Largest distance of an epoch to its grid point */
+	int products;            /* PROD_* outputs made along with the observations (products.h) */
+
+	conv_opt()
+	{
+		format = 0;
+		flush_epochs = 1;
+		idle_ms = 0;
+		cache = false;
+		pipeline = false;
+		t_start = t_end = 0;
+		sig_mask = 0;
+		build_index = false;
+		interval_ms = 0;
+		interval_tol_ms = DECIM_TOL_MS;
+		products = 0;
+	}
+
+	bool selective() const { return t_start != 0 || t_end != 0 || sig_mask != 0; }
+};
+
+// Reasons for dropping an observation (conv_rows)
+#define REJ_SIGNAL    0                 /* Constellation or signal not supported */
+#define REJ_STATE     1                 /* Tracking state without code lock or time of week */
+#define REJ_UNC       2                 /* Uncertainty above MAXPRRUNCMPS or MAXTOWUNCNS */
+#define REJ_RANGE     3                 /* Pseudorange time outside [0, 0.5] s */
+#define REJ_GLO_SLOT  4                 /* GLONASS slot number above 80 */
+#define NREJ          5
+
+#define WARN_SPARSE   0                 /* Epoch with 4 satellites or fewer */
+#define WARN_ROLLOVER 1                 /* Week rollover in the time of reception */
+#define NWARN         2
+
+// Waits of the pipeline stages for one another (conv_opt::pipeline)
+#define STALL_READ    0                 /* Reader thread waited for the converter to free a block */
+#define STALL_PARSE   1                 /* Converter waited for the reader thread */
+#define STALL_OUTPUT  2                 /* Converter waited for the writer thread */
+#define STALL_WRITE   3                 /* Writer thread waited for the converter */
+#define NSTALL        4
+#define WARN_MAX      10                /* Warnings of a kind printed per log; the others are counted */
+
+#define STAT_SYS      (RNX_NSYS + 1)    /* Statistics per system, in sys_code order, and for the others */
+
+// Counters and stage timers of a conversion
+struct conv_stats
+{
+	unsigned long long rows;                        /* Raw rows converted */
+	unsigned long long skipped;                     /* Raw rows left out by the selection (conv_opt) */
+	unsigned long long epochs;                      /* Epochs written */
+	unsigned long long rows_sys[STAT_SYS];
+	unsigned long long obs[STAT_SYS][MAX_FRQ];      /* Observations converted, per signal of sigs */
+	unsigned long long rejected[NREJ][STAT_SYS];
+	unsigned long long warnings[NWARN];
+	unsigned long long stalls[NSTALL];
+	unsigned long long nav_records;                 /* Products (products.h): Nav records read, */
+	unsigned long long ephemerides;                 /* ephemerides decoded */
+	unsigned long long fixes;                       /* and Fix records written */
+	signal_set sigs;                                /* Signals of the output */
+
+	// Wall time (s); parse is what the other stages leave of the total
+	double t_parse, t_convert, t_write, t_total;
+
+	conv_stats()
+	{
+		rows = skipped = epochs = 0;
+		memset(rows_sys, 0, sizeof(rows_sys));
+		memset(obs, 0, sizeof(obs));
+		memset(rejected, 0, sizeof(rejected));
+		memset(warnings, 0, sizeof(warnings));
+		memset(stalls, 0, sizeof(stalls));
+		nav_records = ephemerides = fixes = 0;
+		t_parse = t_convert = t_write = t_total = 0.0;
+	}
+};
+
+struct nav_conv;
+struct fix_conv;
+
+// Conversion state of one log; independent jobs can run in parallel
+struct rnx_conv
+{
+	signal_set sigs;
+
+	// Output
+	const char* outfile;     /* Output name; the extension is replaced by .YYo */
+	FILE* fpw;               /* RINEX file, opened once the first epoch is complete */
+	rnx_out_fn out_fn;       /* Stream (conv_stream.cpp): output callback used instead of a file */
+	void* out_user;
+	rnx_writer out;          /* Buffered observation records of fpw or out_fn, open if out.buf is set */
+	int   format;            /* RNX_FMT_* flags of the output */
+	bool  failed;
+	int   flush_epochs;      /* Flush the file every n epochs, 0 = when the buffer is full */
+	bool  pipeline;          /* The file is written by a thread of its own */
+	obc_writer cache;        /* Cache file of the parsed rows, open if cache.fp is set */
+	nav_conv* nav;           /* Products made from the other lines of the log, NULL if not asked for */
+	fix_conv* fix;
+
+	// Selection (conv_filter.cpp)
+	bool      selective;     /* Rows are checked against the window and signals below */
+	gnss_time t_start, t_end;
+	unsigned  sig_mask;
+	bool      clock_ref;     /* Reference clock taken from a row before the window */
+	bool      done;          /* A row past the end of the window was read */
+
+	// Decimation (conv_filter.cpp)
+	long long interval_nano; /* Grid of the epochs written, 0 = all epochs */
+	long long interval_tol_nano;
+	long long grid_last;     /* Grid point of the last epoch taken */
+	bool      skip;          /* The current epoch is off the grid and not written */
+
+	// Epoch grouping
+	obs_table rows;          /* Rows of the current epoch, converted once it is complete */
+	std::vector<char> partial; /* Stream: start of a line that the next buffer completes */
+	bool first;
+	long long allRxMillis_p;
+	int check_clkdiscp;
+
+	// Reference epoch for the GPS time, reset at each hardware clock discontinuity
+	long long ref_full_bias_nano;
+	double    ref_bias_nano;
+	gps_day   day;
+
+	rnx_epoch repoch;
+	int nepoch;              /* Epochs closed so far */
+	std::vector<sat_state> sat_tab; /* MAX_SYS x MAX_PRN */
+	obs_batch batch;         /* Rows of the epoch being converted that passed the checks */
+
+	// When set, closed epochs are handed over here instead of being written
+	std::vector<rnx_epoch>* collect;
+
+	conv_stats stats;
+	int warned[NWARN];       /* Warnings printed so far, at most WARN_MAX of each kind */
+	bool quiet;              /* Warnings are only counted (server) */
+
+	rnx_conv(const char* file, const conv_opt* opt = NULL)
+	{
+		outfile = file;
+		fpw = NULL;
+		out_fn = NULL;
+		out_user = NULL;
+		memset(&out, 0, sizeof(rnx_writer));
+		nav = NULL;
+		fix = NULL;
+		format = opt ? opt->format : 0;
+		failed = false;
+		flush_epochs = 0;
+		pipeline = opt ? opt->pipeline : false;
+		selective = opt ? opt->selective() : false;
+		t_start = opt ? opt->t_start : 0;
+		t_end = opt ? opt->t_end : 0;
+		sig_mask = opt ? opt->sig_mask : 0;
+		clock_ref = false;
+		done = false;
+		interval_nano = opt ? opt->interval_ms * MILLI_NANO : 0;
+		interval_tol_nano = opt ? opt->interval_tol_ms * MILLI_NANO : 0;
+		grid_last = -1;
+		skip = false;
+		first = true;
+		allRxMillis_p = 0;
+		check_clkdiscp = 0;
+		ref_full_bias_nano = 0;
+		ref_bias_nano = 0.0;
+		nepoch = 0;
+		sat_tab.resize(MAX_SYS * MAX_PRN);
+		collect = NULL;
+		memset(warned, 0, sizeof(warned));
+		quiet = false;
+		if (format & RNX_FMT_CRX) add_known_signals(&sigs);
+	}
+};
+
+extern char sys_code[RNX_NSYS];
+
+int  sys_code_function(int sys);
+const char* path_basename(const char* path);
+int  add_signal(signal_set* ss, int sig);
+void classify_signal(signal_set* ss, obs_table* t, size_t i);
+void gpsday2ymd(long long day, int *ymd);
+long long ymd2gpsday(int y, int m, int d);
+void gpstime2ymdhms(long long *time_nano, long long *full_bias_nano, double *bias_nano,double *time, gps_day* cache = NULL);
+
+size_t print_rnx_header(char* buf, const signal_set* ss);
+std::string output_name(const char* outfile, const char* ext);
+FILE* open_rnx_file(const char* outfile, const rnx_epoch* first, int format);
+void clear_rnx_epoch(rnx_epoch* e);
+sat_state* find_sat_state(rnx_conv* conv, int sys, int prn);
+void correct_gal_4ms(rnx_conv* conv, rnx_epoch& repoch);
+
+void conv_flush(rnx_conv* conv);
+void write_epoch(rnx_conv* conv, const rnx_epoch& e);
+void close_epoch(rnx_conv* conv, long long allRxMillis);
+void start_epoch(rnx_conv* conv, const obs_table* t, size_t i);
+void conv_rows(rnx_conv* conv, const obs_table* t, size_t i0, size_t i1);
+void conv_row(rnx_conv* conv);
+void conv_line(rnx_conv* conv, const char* line, size_t len);
+bool open_cache_file(rnx_conv* conv);
+void open_products(rnx_conv* conv, const conv_opt* opt, const char* infile);
+void conv_other_line(rnx_conv* conv, const char* line, size_t len);
+bool conv_finish(rnx_conv* conv);
+bool convert_file(const char* infile, const char* outfile, const conv_opt* opt = NULL, conv_stats* stats = NULL);
+bool convert_follow(const char* infile, const char* outfile, const conv_opt* opt, conv_stats* stats = NULL);
+
+// Selection of the rows (conv_filter.cpp): time window, signals and decimation
+bool parse_gps_time(const char* str, gnss_time* t);
+bool parse_signals(const char* str, unsigned* mask);
+bool select_row(rnx_conv* conv, const raw_head* h);
+bool off_grid(rnx_conv* conv, const obs_table* t, size_t i);
+
+// Stream conversion for embedding (conv_stream.cpp): the text of a log is pushed
+// in buffers of any size and the RINEX output goes to a callback
+rnx_conv* conv_open_stream(rnx_out_fn out, void* user, const conv_opt* opt = NULL);
+bool conv_push(rnx_conv* conv, const char* data, size_t len);
+bool conv_push_line(rnx_conv* conv, const char* line, size_t len);
+bool conv_end(rnx_conv* conv, conv_stats* stats = NULL);
+void conv_reset(rnx_conv* conv);
+void conv_close_stream(rnx_conv* conv);
+
+// Conversion server (conv_server.cpp): logs sent over a Unix domain socket or a
+// local TCP port are converted by a pool of warm stream converters
+bool run_server(const char* addr, int nthreads, int queue_max);
+void server_stop();
+
+struct thread_pool;
+bool convert_file_parallel(const char* infile, const char* outfile, thread_pool* pool, const conv_opt* opt = NULL, conv_stats* stats = NULL);
+
+// Metrics (conv_stats.cpp)
+void take_stats(rnx_conv* conv, double t_total, conv_stats* stats);
+void add_stats(conv_stats* sum, const conv_stats* s);
+bool write_metrics(const char* file, const std::vector<const char*>& inputs, const std::vector<conv_stats>& stats);
+
+#endif
@@ -0,0 +1,425 @@
+/*
+// RINEX 3 navigation file from the Nav records of a log (products.h).
+// A Nav record holds one navigation message of a satellite as broadcast:
+//   Nav,Svid,Type,Status,MessageId,Sub-messageId,Data(Bytes)
+// with the data as signed bytes. GPS and QZSS L1 C/A subframes carry 10 words of
+// 30 bits, each in the low bits of 4 bytes; their parity is checked and the data
+// bits are restored (inverted after a word ending with D30* = 1). Galileo I/NAV
+// pages carry the even and odd page parts, 2 x 114 bits; their CRC is checked
+// and the 128-bit word is taken from the two data fields. The scale factors are
+// those of IS-GPS-200 and the Galileo OS SIS ICD.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "rnx_conv.h"
+#include "products.h"
+#include "log_reader.h"
+
+#define SC2RAD      3.1415926535898     /* Semi-circle to radian (IS-GPS-200) */
+#define P2_5        0.03125
+#define P2_19       1.907348632812500E-06
+#define P2_29       1.862645149230957E-09
+#define P2_31       4.656612873077393E-10
+#define P2_32       2.328306436538696E-10
+#define P2_33       1.164153218269348E-10
+#define P2_34       5.820766091346741E-11
+#define P2_43       1.136868377216160E-13
+#define P2_46       1.421085471520200E-14
+#define P2_55       2.775557561562891E-17
+#define P2_59       1.734723475976807E-18
+
+static const double ura_m[16] = { 2.4, 3.4, 4.85, 6.85, 9.65, 13.65, 24.0, 48.0, 96.0, 192.0,
+	384.0, 768.0, 1536.0, 3072.0, 6144.0, 6144.0 };
+
+static unsigned getbitu(const unsigned char* buf, int pos, int len)
+{
+	unsigned v = 0;
+	for (int i = pos; i < pos + len; i++) v = (v << 1) | ((buf[i / 8] >> (7 - i % 8)) & 1u);
+	return v;
+}
+
+static int getbits(const unsigned char* buf, int pos, int len)
+{
+	unsigned v = getbitu(buf, pos, len);
+	if (len < 32 && (v >> (len - 1) & 1u)) v |= ~0u << len;
+	return (int)v;
+}
+
+static void setbitu(unsigned char* buf, int pos, int len, unsigned v)
+{
+	for (int i = pos + len - 1; i >= pos; i--, v >>= 1) {
+		if (v & 1u) buf[i / 8] |= (unsigned char)(0x80 >> (i % 8));
+		else buf[i / 8] &= (unsigned char)~(0x80 >> (i % 8));
+	}
+}
+
+static int popcount32(unsigned v)
+{
+	int n = 0;
+	for (; v; v &= v - 1) n++;
+	return n;
+}
+
+// Check the parity of a GPS word: bits 31-30 D29* D30* of the previous word,
+// 29-6 data, 5-0 parity. The data bits are inverted first when D30* is set.
+static bool gps_parity(unsigned word)
+{
+	static const unsigned hamming[6] = { 0xBB1F3480, 0x5D8F9A40, 0xAEC7CD00, 0x5763E680, 0x6BB1F340, 0x8B7A89C0 };
+	unsigned parity = 0;
+	for (int i = 0; i < 6; i++) parity |= (unsigned)(popcount32(word & hamming[i]) & 1) << (5 - i);
+	return parity == (word & 0x3F);
+}
+
+// Data bits of the 10 words of a GPS or QZSS subframe; false if a word fails its
+// parity. Receivers that hand over the words with the data already restored
+// are accepted as well.
+static bool gps_subframe(const unsigned char* data, unsigned char* sub)
+{
+	unsigned prev = 0;                  /* D29* and D30*: 0 before the TLM word */
+	for (int k = 0; k < 10; k++) {
+		const unsigned char* b = data + 4 * k;
+		unsigned w = ((unsigned)b[0] << 24 | (unsigned)b[1] << 16 | (unsigned)b[2] << 8 | b[3]) & 0x3FFFFFFF;
+		unsigned word = prev << 30 | w;
+		if (prev & 1) word ^= 0x3FFFFFC0;
+		if (!gps_parity(word)) {
+			word = prev << 30 | w;
+			if (!(prev & 1) || !gps_parity(word)) return false;
+		}
+		setbitu(sub, 24 * k, 24, word >> 6 & 0xFFFFFF);
+		prev = w & 3;
+	}
+	return true;
+}
+
+// CRC-24Q of the first n bits of buf
+static unsigned crc24q_bits(const unsigned char* buf, int n)
+{
+	unsigned crc = 0;
+	for (int i = 0; i < n; i++) {
+		unsigned top = (crc >> 23 & 1u) ^ (buf[i / 8] >> (7 - i % 8) & 1u);
+		crc = crc << 1 & 0xFFFFFF;
+		if (top) crc ^= 0x864CFB;
+	}
+	return crc;
+}
+
+// Word of a Galileo I/NAV page: the even part (E/O, page type, 112 data bits)
+// and the odd part (E/O, page type, 16 data bits, reserved, SAR, spare, CRC,
+// SSP). False for an alert page, parts out of order or a CRC error.
+static bool gal_word(const unsigned char* data, unsigned char* word)
+{
+	if (getbitu(data, 0, 1) != 0 || getbitu(data, 114, 1) != 1) return false;
+	if (getbitu(data, 1, 1) || getbitu(data, 115, 1)) return false;
+	if (crc24q_bits(data, 196) != getbitu(data, 196, 24)) return false;
+	for (int i = 0; i < 112; i += 16) setbitu(word, i, 16, getbitu(data, 2 + i, 16));
+	setbitu(word, 112, 16, getbitu(data, 116, 16));
+	return true;
+}
+
+// Keep a new ephemeris of a satellite, unless it repeats the last one
+static void add_eph(nav_conv* nav, nav_sat* st, const nav_eph& eph)
+{
+	if (st->last >= 0) {
+		const nav_eph& p = nav->ephs[st->last];
+		if (p.iode == eph.iode && p.toe == eph.toe && p.week == eph.week) return;
+	}
+	st->last = (int)nav->ephs.size();
+	nav->ephs.push_back(eph);
+}
+
+// Ephemeris of GPS or QZSS subframes 1-3 with the same IODE and IODC
+static void decode_lnav(nav_conv* nav, nav_sat* st, char sys, int prn)
+{
+	const unsigned char* s1 = st->sub[0];
+	const unsigned char* s2 = st->sub[1];
+	const unsigned char* s3 = st->sub[2];
+	int iodc = (int)(getbitu(s1, 70, 2) << 8 | getbitu(s1, 168, 8));
+	int iode = (int)getbitu(s2, 48, 8);
+	if (iode != (int)getbitu(s3, 216, 8) || iode != (iodc & 0xFF)) return;
+
+	nav_eph eph;
+	memset(&eph, 0, sizeof(eph));
+	eph.sys = sys;
+	eph.prn = prn;
+	eph.iode = iode;
+	eph.iodc = iodc;
+	eph.ttr = getbitu(s1, 24, 17) * 6.0;
+	eph.week = (int)getbitu(s1, 48, 10);
+	eph.code = (int)getbitu(s1, 58, 2);
+	eph.accuracy = ura_m[getbitu(s1, 60, 4)];
+	eph.svh = (int)getbitu(s1, 64, 6);
+	eph.flag = (int)getbitu(s1, 72, 1);
+	eph.tgd[0] = getbits(s1, 160, 8) * P2_31;
+	eph.toc = getbitu(s1, 176, 16) * 16.0;
+	eph.f2 = getbits(s1, 192, 8) * P2_55;
+	eph.f1 = getbits(s1, 200, 16) * P2_43;
+	eph.f0 = getbits(s1, 216, 22) * P2_31;
+
+	eph.crs = getbits(s2, 56, 16) * P2_5;
+	eph.deln = getbits(s2, 72, 16) * P2_43 * SC2RAD;
+	eph.m0 = getbits(s2, 88, 32) * P2_31 * SC2RAD;
+	eph.cuc = getbits(s2, 120, 16) * P2_29;
+	eph.e = getbitu(s2, 136, 32) * P2_33;
+	eph.cus = getbits(s2, 168, 16) * P2_29;
+	eph.sqrt_a = getbitu(s2, 184, 32) * P2_19;
+	eph.toe = getbitu(s2, 216, 16) * 16.0;
+	int fit_flag = (int)getbitu(s2, 232, 1);
+
+	eph.cic = getbits(s3, 48, 16) * P2_29;
+	eph.omg0 = getbits(s3, 64, 32) * P2_31 * SC2RAD;
+	eph.cis = getbits(s3, 96, 16) * P2_29;
+	eph.i0 = getbits(s3, 112, 32) * P2_31 * SC2RAD;
+	eph.crc = getbits(s3, 144, 16) * P2_5;
+	eph.omg = getbits(s3, 160, 32) * P2_31 * SC2RAD;
+	eph.omgd = getbits(s3, 192, 24) * P2_43 * SC2RAD;
+	eph.idot = getbits(s3, 224, 14) * P2_43 * SC2RAD;
+
+	if (sys == 'J') eph.fit = fit_flag;
+	else if (!fit_flag) eph.fit = 4.0;
+	else if (iodc >= 240 && iodc <= 247) eph.fit = 8.0;       /* IS-GPS-200 table 20-XII */
+	else if ((iodc >= 248 && iodc <= 255) || iodc == 496) eph.fit = 14.0;
+	else if ((iodc >= 497 && iodc <= 503) || iodc >= 1021) eph.fit = 26.0;
+	else eph.fit = 6.0;
+	add_eph(nav, st, eph);
+}
+
+// SISA index to metres; -1 for no accuracy prediction available
+static double sisa_m(int sisa)
+{
+	if (sisa <= 49) return sisa * 0.01;
+	if (sisa <= 74) return 0.5 + (sisa - 50) * 0.02;
+	if (sisa <= 99) return 1.0 + (sisa - 75) * 0.04;
+	if (sisa <= 125) return 2.0 + (sisa - 100) * 0.16;
+	return -1.0;
+}
+
+// Ephemeris of Galileo I/NAV words 1-5, with the same IODnav in words 1-4
+static void decode_inav(nav_conv* nav, nav_sat* st, int prn)
+{
+	const unsigned char* w1 = st->word[0];
+	const unsigned char* w2 = st->word[1];
+	const unsigned char* w3 = st->word[2];
+	const unsigned char* w4 = st->word[3];
+	const unsigned char* w5 = st->word[4];
+	int iod = (int)getbitu(w1, 6, 10);
+	if ((int)getbitu(w2, 6, 10) != iod || (int)getbitu(w3, 6, 10) != iod || (int)getbitu(w4, 6, 10) != iod) return;
+	if ((int)getbitu(w4, 16, 6) != prn) return;
+
+	nav_eph eph;
+	memset(&eph, 0, sizeof(eph));
+	eph.sys = 'E';
+	eph.prn = prn;
+	eph.iode = iod;
+	eph.toe = getbitu(w1, 16, 14) * 60.0;
+	eph.m0 = getbits(w1, 30, 32) * P2_31 * SC2RAD;
+	eph.e = getbitu(w1, 62, 32) * P2_33;
+	eph.sqrt_a = getbitu(w1, 94, 32) * P2_19;
+
+	eph.omg0 = getbits(w2, 16, 32) * P2_31 * SC2RAD;
+	eph.i0 = getbits(w2, 48, 32) * P2_31 * SC2RAD;
+	eph.omg = getbits(w2, 80, 32) * P2_31 * SC2RAD;
+	eph.idot = getbits(w2, 112, 14) * P2_43 * SC2RAD;
+
+	eph.omgd = getbits(w3, 16, 24) * P2_43 * SC2RAD;
+	eph.deln = getbits(w3, 40, 16) * P2_43 * SC2RAD;
+	eph.cuc = getbits(w3, 56, 16) * P2_29;
+	eph.cus = getbits(w3, 72, 16) * P2_29;
+	eph.crc = getbits(w3, 88, 16) * P2_5;
+	eph.crs = getbits(w3, 104, 16) * P2_5;
+	eph.accuracy = sisa_m((int)getbitu(w3, 120, 8));
+
+	eph.cic = getbits(w4, 22, 16) * P2_29;
+	eph.cis = getbits(w4, 38, 16) * P2_29;
+	eph.toc = getbitu(w4, 54, 14) * 60.0;
+	eph.f0 = getbits(w4, 68, 31) * P2_34;
+	eph.f1 = getbits(w4, 99, 21) * P2_46;
+	eph.f2 = getbits(w4, 120, 6) * P2_59;
+
+	eph.tgd[0] = getbits(w5, 47, 10) * P2_32;
+	eph.tgd[1] = getbits(w5, 57, 10) * P2_32;
+	int e5b_hs = (int)getbitu(w5, 67, 2);
+	int e1b_hs = (int)getbitu(w5, 69, 2);
+	int e5b_dvs = (int)getbitu(w5, 71, 1);
+	int e1b_dvs = (int)getbitu(w5, 72, 1);
+	eph.svh = e1b_dvs | e1b_hs << 1 | e5b_dvs << 6 | e5b_hs << 7;
+	eph.week = (int)getbitu(w5, 73, 12) + 1024;         /* GST week, counted as the GPS week */
+	eph.ttr = getbitu(w5, 85, 20);
+	eph.code = 0x201;                                   /* I/NAV E1-B, clock for E5b/E1 */
+	add_eph(nav, st, eph);
+}
+
+// Columns of the Nav records, from the "# Nav," line of the log header
+void nav_columns(nav_conv* nav, const char* line, size_t len)
+{
+	const char* end = line + len;
+	const char* p = (const char*)memchr(line, ',', len);
+	for (int k = 0; p; k++) {
+		const char* token = p + 1;
+		p = (const char*)memchr(token, ',', end - token);
+		std::string name(token, p ? p : end);
+		while (!name.empty() && (name.back() == '\r' || name.back() == ' ')) name.pop_back();
+		if (name == "Svid") nav->col_svid = k;
+		else if (name == "Type") nav->col_type = k;
+		else if (name.compare(0, 4, "Data") == 0) nav->col_data = k;
+	}
+}
+
+// Take one Nav record
+void nav_line(nav_conv* nav, const char* line, size_t len)
+{
+	const char* end = line + len;
+	const char* p = (const char*)memchr(line, ',', len);  /* Skip the "Nav" tag */
+	int svid = 0, type = 0, n = 0;
+	unsigned char data[NAV_GPS_BYTES];
+	for (int k = 0; p && n < NAV_GPS_BYTES; k++) {
+		const char* token = p + 1;
+		p = (const char*)memchr(token, ',', end - token);
+		const char* e = p ? p : end;
+		if (k == nav->col_svid) svid = log_parse_int(token, e);
+		else if (k == nav->col_type) type = log_parse_int(token, e);
+		else if (k >= nav->col_data) data[n++] = (unsigned char)log_parse_int(token, e);
+	}
+	nav->records++;
+
+	unsigned char sub[30];
+	if (type == NAV_GPS_L1CA || type == NAV_QZS_L1CA) {
+		int prn = type == NAV_QZS_L1CA ? svid - 192 : svid;  /* QZSS PRN 193- */
+		if (prn < 1 || prn >= NAV_MAX_PRN || n < NAV_GPS_BYTES) return;
+		if (!gps_subframe(data, sub)) {
+			nav->rejected++;
+			return;
+		}
+		int id = (int)getbitu(sub, 43, 3);
+		if (id < 1 || id > 3) return;  /* Almanac and other pages */
+		int sys = type == NAV_QZS_L1CA ? 1 : 0;
+		nav_sat* st = &nav->sats[sys * NAV_MAX_PRN + prn];
+		memcpy(st->sub[id - 1], sub, sizeof(sub));
+		st->have |= 1u << (id - 1);
+		if ((st->have & 7u) == 7u) decode_lnav(nav, st, sys ? 'J' : 'G', prn);
+	}
+	else if (type == NAV_GAL_INAV) {
+		if (svid < 1 || svid >= NAV_MAX_PRN || n < NAV_GAL_BYTES) return;
+		unsigned char word[16];
+		if (!gal_word(data, word)) {
+			nav->rejected++;
+			return;
+		}
+		int id = (int)getbitu(word, 0, 6);
+		if (id < 1 || id > 5) return;
+		nav_sat* st = &nav->sats[2 * NAV_MAX_PRN + svid];
+		memcpy(st->word[id - 1], word, sizeof(word));
+		st->have |= 1u << (id - 1);
+		if ((st->have & 0x1Fu) == 0x1Fu) decode_inav(nav, st, svid);
+	}
+}
+
+// Week of a reference time (s of week) given near the transmission time
+static int ref_week(int week, double t, double ttr)
+{
+	if (t - ttr > 302400.0) return week - 1;
+	if (t - ttr < -302400.0) return week + 1;
+	return week;
+}
+
+static int sys_order(char sys)
+{
+	const char* order = "GEJ";
+	return (int)(strchr(order, sys) - order);
+}
+
+// One navigation record: the epoch line and the broadcast orbit lines
+static size_t print_nav_record(char* buf, const nav_eph& e)
+{
+	int toc_week = ref_week(e.week, e.toc, e.ttr);
+	int toe_week = ref_week(e.week, e.toe, e.ttr);
+	long long toc = (long long)toc_week * 604800 + (long long)e.toc;
+	int ymd[3];
+	gpsday2ymd(toc / 86400, ymd);
+	int sod = (int)(toc % 86400);
+
+	char* p = buf;
+	p += sprintf(p, "%c%02d %04d %02d %02d %02d %02d %02d%19.12E%19.12E%19.12E\n", e.sys, e.prn,
+		ymd[0], ymd[1], ymd[2], sod / 3600, sod / 60 % 60, sod % 60, e.f0, e.f1, e.f2);
+	p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", (double)e.iode, e.crs, e.deln, e.m0);
+	p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", e.cuc, e.e, e.cus, e.sqrt_a);
+	p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", e.toe, e.cic, e.omg0, e.cis);
+	p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", e.i0, e.crc, e.omg, e.omgd);
+	if (e.sys == 'E') {
+		p += sprintf(p, "    %19.12E%19.12E%19.12E\n", e.idot, (double)e.code, (double)toe_week);
+		p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", e.accuracy, (double)e.svh, e.tgd[0], e.tgd[1]);
+		p += sprintf(p, "    %19.12E\n", e.ttr);
+	}
+	else {
+		p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", e.idot, (double)e.code, (double)toe_week, (double)e.flag);
+		p += sprintf(p, "    %19.12E%19.12E%19.12E%19.12E\n", e.accuracy, (double)e.svh, e.tgd[0], (double)e.iodc);
+		p += sprintf(p, "    %19.12E%19.12E\n", e.ttr, e.fit);
+	}
+	return p - buf;
+}
+
+// Write the navigation file once the log has been read. The 10-bit GPS and QZSS
+// weeks are completed with the GPS time of the observations (ms), or failing
+// that the Nav records are dated to the current 1024-week cycle.
+bool nav_finish(nav_conv* nav, long long gps_millis, bool quiet)
+{
+	if (nav->ephs.empty()) {
+		if (!quiet) printf("No GPS, QZSS or Galileo navigation messages decoded from %s\n", nav->log);
+		return true;
+	}
+	long long now_week = gps_millis > 0 ? gps_millis / (WEEK_NANO / MILLI_NANO) :
+		(long long)(time(NULL) - 315964800) / 604800;       /* Seconds from 1970 to the GPS epoch */
+	for (size_t i = 0; i < nav->ephs.size(); i++) {
+		nav_eph& e = nav->ephs[i];
+		if (e.sys == 'E') continue;
+		long long w = e.week + (now_week - e.week + 512) / 1024 * 1024;
+		e.week = (int)w;
+	}
+	std::vector<nav_eph> ephs = nav->ephs;
+	std::stable_sort(ephs.begin(), ephs.end(), [](const nav_eph& a, const nav_eph& b) {
+		if (a.sys != b.sys) return sys_order(a.sys) < sys_order(b.sys);
+		if (a.prn != b.prn) return a.prn < b.prn;
+		double ta = ref_week(a.week, a.toc, a.ttr) * 604800.0 + a.toc;
+		double tb = ref_week(b.week, b.toc, b.ttr) * 604800.0 + b.toc;
+		return ta < tb;
+	});
+
+	// The file takes the year of the earliest ephemeris
+	long long first = -1;
+	for (size_t i = 0; i < ephs.size(); i++) {
+		long long t = ref_week(ephs[i].week, ephs[i].toc, ephs[i].ttr) * 604800LL + (long long)ephs[i].toc;
+		if (first < 0 || t < first) first = t;
+	}
+	int ymd[3];
+	gpsday2ymd(first / 86400, ymd);
+	char ext[16];
+	sprintf(ext, ".%02dp%s", ymd[0] % 100, (nav->format & RNX_FMT_GZ) ? ".gz" : "");
+	std::string name = output_name(nav->outfile, ext);
+
+	FILE* fp = fopen(name.c_str(), (nav->format & RNX_FMT_GZ) ? "wb" : "w");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s\n", name.c_str());
+		return false;
+	}
+	rnx_writer w;
+	bool ok = rnx_writer_open(&w, fp, nav->format & RNX_FMT_GZ);
+	if (ok) {
+		std::string header = std::string(NAV_VER) + "\n" + RNX_PGM + "\n" + RNX_END + "\n";
+		ok = rnx_writer_header(&w, header.data(), header.size());
+	}
+	char buf[1024];
+	for (size_t i = 0; i < ephs.size() && ok; i++) {
+		size_t n = print_nav_record(buf, ephs[i]);
+		ok = rnx_writer_text(&w, buf, n);
+	}
+	if (!rnx_writer_close(&w)) ok = false;
+	if (fclose(fp) != 0) ok = false;
+	if (!ok) fprintf(stderr, "Writing %s failed\n", name.c_str());
+	return ok;
+}
@@ -0,0 +1,391 @@
+/*
+// Parallel conversion of a single GnssLogger file.
+// The mapped log is cut into chunks that start at epoch boundaries. Chunks are
+// parsed and converted to rnx_epochs on the thread pool, then replayed in time
+// order through the same epoch writer as the serial path, so the output is
+// byte-identical. The state that crosses chunk boundaries (clock discontinuity
+// reference epoch, signal order, previous epoch for the Galileo 4 ms check) is
+// resolved serially between the parallel passes. A cache file (.obc) is cut at
+// its blocks, whose rows are copied instead of parsed. A log with an epoch
+// index (.obi) is cut at the epochs it lists, and a time window is converted
+// from the epochs at its ends. The lines of the products (products.h) are
+// gathered by the parse pass and handed to them in file order.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include <vector>
+#include <utility>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#include "rnx_conv.h"
+#include "thread_pool.h"
+#include "epoch_index.h"
+
+#define PAR_CHUNK   (8 << 20)           /* Approximate input bytes per chunk */
+#define PAR_BATCH   4                   /* Chunks per worker kept in memory at a time */
+#define PAR_ROW_BYTES 200               /* Typical length of a Raw line, to size the row tables */
+
+// A slice of the log starting at an epoch boundary, or a block of a cache file
+struct par_chunk
+{
+	const char* begin;
+	const char* end;
+	obc_block block;                    /* Cache file: rows of the chunk, nrows = 0 for a text log */
+
+	// Pass 1: parsed and classified rows
+	obs_table rows;
+	obs_table raw;                      /* Rows as parsed, when they are saved to a cache file */
+	std::vector<std::pair<const char*, size_t> > other; /* Other lines, when products are made */
+	signal_set sigs;                    /* Signals in order of first appearance in the chunk */
+	int sig_epoch[MAX_SYS][MAX_FRQ];    /* Chunk epoch in which each of them first appears */
+	int nepoch;
+	int disc_first;                     /* Clock discontinuity count of the first and last epoch */
+	int disc_last;
+	bool changed;                       /* Discontinuity inside the chunk and the reference epoch it sets */
+	long long change_full_bias_nano;
+	double    change_bias_nano;
+
+	// Resolved from the previous chunks: reference epoch in effect at the first row
+	long long ref_full_bias_nano;
+	double    ref_bias_nano;
+
+	// Pass 2: converted epochs and the counters of their conversion
+	std::vector<rnx_epoch> epochs;
+	conv_stats stats;
+
+	par_chunk()
+	{
+		begin = end = NULL;
+		memset(&block, 0, sizeof(block));
+		memset(sig_epoch, 0, sizeof(sig_epoch));
+		nepoch = 0;
+		disc_first = disc_last = 0;
+		changed = false;
+		change_full_bias_nano = ref_full_bias_nano = 0;
+		change_bias_nano = ref_bias_nano = 0.0;
+	}
+};
+
+// Start of the first epoch beginning at or after p, or end if there is none
+static const char* next_epoch(const char* p, const char* data, const char* end)
+{
+	if (p >= end) return end;
+	if (p > data && p[-1] != '\n') {
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		if (!nl) return end;
+		p = nl + 1;
+	}
+
+	log_reader rd;
+	log_open_mem(&rd, p, end - p);
+
+	obs_table t;
+	const char* line = NULL;
+	size_t len = 0;
+	while (log_next_line(&rd, &line, &len)) {
+		if (len < 4 || memcmp(line, "Raw,", 4) != 0) continue;
+		if (!t.add_row(line, line + len)) continue;
+		if (t.rx_millis(t.size() - 1) != t.rx_millis(0)) return line;
+	}
+	return end;
+}
+
+// Pass 1: parse (or copy from the cache file) and classify the rows of a chunk
+// and note its epochs
+static void parse_chunk(par_chunk* c, bool keep_raw, bool keep_other)
+{
+	obs_table* t = &c->rows;
+	if (c->block.nrows) {
+		obc_append(t, &c->block, 0, c->block.nrows);
+	}
+	else {
+		log_reader rd;
+		log_open_mem(&rd, c->begin, c->end - c->begin);
+		t->reserve((c->end - c->begin) / PAR_ROW_BYTES);
+
+		const char* line = NULL;
+		size_t len = 0;
+		while (log_next_line(&rd, &line, &len)) {
+			if (len < 4 || memcmp(line, "Raw,", 4) != 0) {
+				if (keep_other) c->other.push_back(std::make_pair(line, len));
+				continue;
+			}
+			t->add_row(line, line + len);
+		}
+	}
+	if (keep_raw) c->raw = *t;
+
+	long long millis_p = 0;
+	for (size_t i = 0; i < t->size(); i++) {
+		long long millis = t->rx_millis(i);
+		int disc = t->hardware_clock_discountinuity_count[i];
+		if (c->nepoch == 0) {
+			c->nepoch = 1;
+			millis_p = millis;
+			c->disc_first = c->disc_last = disc;
+		}
+		else if (millis != millis_p) {
+			c->nepoch++;
+			millis_p = millis;
+			if (disc != c->disc_last) {
+				c->changed = true;
+				c->change_full_bias_nano = t->full_bias_nano[i];
+				c->change_bias_nano = t->bias_nano[i];
+			}
+			c->disc_last = disc;
+		}
+
+		int sys_n = sys_code_function(t->constellation_type[i]); /* SYS_* match the constellation types */
+		int nsig = sys_n >= 0 ? c->sigs.nsignals[sys_n] : 0;
+		classify_signal(&c->sigs, t, i);
+		if (sys_n >= 0 && c->sigs.nsignals[sys_n] > nsig) {
+			c->sig_epoch[sys_n][nsig] = c->nepoch - 1;
+		}
+	}
+}
+
+// Renumber the signal indices of a chunk's rows from its own table to the merged one
+static void remap_chunk(par_chunk* c, const signal_set* sigs)
+{
+	signed char map[MAX_SYS][MAX_FRQ];
+	for (int s = 0; s < MAX_SYS; s++) {
+		for (int k = 0; k < c->sigs.nsignals[s]; k++) map[s][k] = sigs->frq[c->sigs.sig[s][k]];
+	}
+
+	obs_table* t = &c->rows;
+	for (size_t i = 0; i < t->size(); i++) {
+		if (t->frq[i] < 0) continue;
+		t->frq[i] = map[sys_code_function(t->sys[i])][t->frq[i]];
+	}
+}
+
+// Pass 2: convert the rows of a chunk into epochs with the merged signal table
+static void convert_chunk(par_chunk* c, const signal_set* sigs)
+{
+	const obs_table* t = &c->rows;
+	if (t->size() == 0) return;
+	remap_chunk(c, sigs);
+
+	rnx_conv conv(NULL);
+	conv.sigs = *sigs;
+	conv.collect = &c->epochs;
+
+	// The first row opens an epoch, exactly as after a boundary in the serial path
+	conv.first = false;
+	conv.allRxMillis_p = t->rx_millis(0);
+	conv.check_clkdiscp = t->hardware_clock_discountinuity_count[0];
+	conv.ref_full_bias_nano = c->ref_full_bias_nano;
+	conv.ref_bias_nano = c->ref_bias_nano;
+
+	size_t i0 = 0;
+	for (size_t i = 1; i < t->size(); i++) {
+		if (t->rx_millis(i) == conv.allRxMillis_p) continue;
+		conv_rows(&conv, t, i0, i);
+		start_epoch(&conv, t, i);
+		i0 = i;
+	}
+	conv_rows(&conv, t, i0, t->size());
+
+	// The last epoch is closed by the first row of the next chunk
+	conv.repoch.rx_millis = conv.allRxMillis_p;
+	c->epochs.push_back(std::move(conv.repoch));
+	c->stats = conv.stats;
+	c->stats.sigs = *sigs;
+	c->stats.t_convert = 0.0;           /* Pass 2 is timed as a whole */
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+bool convert_file_parallel(const char* infile, const char* outfile, thread_pool* pool, const conv_opt* opt, conv_stats* stats)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	log_reader rd;
+	if (!log_open(&rd, infile)) {
+		fprintf(stderr, "Cannot open %s\n", infile);
+		return false;
+	}
+	// A cache file saved by an earlier run is read block by block instead
+	bool cached = rd.mapped && obc_is_cache(rd.data, rd.size);
+
+	// Only a time window with an index is converted here; other selections,
+	// decimation, and a window with products (which take the whole log) serially
+	epoch_index ix;
+	bool indexed = rd.mapped && !cached && opt && (opt->selective() || opt->build_index) && obi_open(infile, &ix, opt->build_index);
+	if (!rd.mapped || pool->size() < 2 || (opt && (opt->pipeline || opt->sig_mask || opt->interval_ms ||
+		(opt->selective() && (!indexed || opt->products))))) {
+		log_close(&rd);
+		return convert_file(infile, outfile, opt, stats);
+	}
+	const char* data = rd.data;
+	const char* end = rd.data + rd.size;
+	const char* p = data;
+	size_t nindex = ix.entries.size();
+	size_t k0 = indexed && opt->t_start ? obi_find_time(&ix, opt->t_start) : 0;
+	if (indexed && opt->t_end) {
+		size_t k1 = obi_find_time(&ix, opt->t_end);
+		if (k1 < nindex) end = data + ix.entries[k1].offset;
+	}
+	if (k0 > 0 && k0 < nindex) p = data + ix.entries[k0].offset;   /* From the start otherwise, for the log header */
+	else if (k0 > 0) p = end;
+	if (p > end) p = end;
+
+	size_t nblocks = cached ? obc_nblocks(rd.data) : 0;
+	size_t kblock = 0;
+	bool read_ok = true;
+
+	rnx_conv writer(outfile, opt);
+	if (!cached && opt && opt->cache) open_cache_file(&writer);
+	bool keep_raw = writer.cache.fp != NULL;
+	if (cached && opt && opt->products) printf("%s is a cache file of Raw rows only; no navigation or Fix output\n", infile);
+	else open_products(&writer, opt, infile);
+	bool keep_other = writer.nav || writer.fix;
+
+	// Signals of the whole log and the epoch in which each first appears. An epoch
+	// is written with the signals seen up to its end, as in the serial path.
+	signal_set sigs;
+	int sig_epoch[MAX_SYS][MAX_FRQ];
+	int nepoch = 0;
+	if (writer.format & RNX_FMT_CRX) {
+		add_known_signals(&sigs);
+		memset(sig_epoch, 0, sizeof(sig_epoch));
+	}
+
+	// State carried from one chunk to the next
+	bool started = false;
+	int disc_last = 0;
+	long long ref_full_bias_nano = 0;
+	double    ref_bias_nano = 0.0;
+	if (k0 > 0 && k0 < nindex) {
+		started = true;
+		disc_last = ix.entries[k0].disc;
+		ref_full_bias_nano = ix.entries[k0].ref_full_bias_nano;
+		ref_bias_nano = ix.entries[k0].ref_bias_nano;
+	}
+	rnx_epoch pending;                  /* Last epoch so far, written once the next one is known */
+	bool has_pending = false;
+	int pending_index = 0;
+
+	int nbatch = pool->size() * PAR_BATCH;
+	while ((cached ? kblock < nblocks : p < end) && read_ok && !writer.failed)
+	{
+		std::vector<par_chunk> chunks;
+		if (cached) {
+			chunks.resize(nblocks - kblock < (size_t)nbatch ? nblocks - kblock : nbatch);
+			for (size_t i = 0; i < chunks.size() && read_ok; i++, kblock++) {
+				read_ok = obc_get_block(rd.data, rd.size, kblock, &chunks[i].block);
+			}
+			if (!read_ok) break;
+		}
+		else {
+			std::vector<const char*> bounds;
+			bounds.push_back(p);
+			for (int i = 0; i < nbatch && p < end; i++) {
+				const char* q = (size_t)(end - p) > PAR_CHUNK ? p + PAR_CHUNK : end;
+				if (indexed) {
+					size_t k = obi_find_offset(&ix, (unsigned long long)(q - data));
+					p = k < nindex && data + ix.entries[k].offset < end ? data + ix.entries[k].offset : end;
+				}
+				else p = next_epoch(q, data, end);
+				bounds.push_back(p);
+			}
+			chunks.resize(bounds.size() - 1);
+			for (size_t i = 0; i < chunks.size(); i++) {
+				chunks[i].begin = bounds[i];
+				chunks[i].end = bounds[i + 1];
+			}
+		}
+		for (size_t i = 0; i < chunks.size(); i++) {
+			par_chunk* c = &chunks[i];
+			pool->submit([c, keep_raw, keep_other] { parse_chunk(c, keep_raw, keep_other); });
+		}
+		pool->wait();
+		for (size_t i = 0; i < chunks.size() && keep_other; i++) {
+			for (size_t k = 0; k < chunks[i].other.size(); k++) conv_other_line(&writer, chunks[i].other[k].first, chunks[i].other[k].second);
+		}
+
+		// Chunks start at epoch boundaries, so each one is a block of the cache file
+		if (keep_raw) {
+			for (size_t i = 0; i < chunks.size(); i++) obc_write_block(&writer.cache, &chunks[i].raw);
+		}
+
+		// Resolve the reference epoch at each chunk start and merge the signal tables
+		int epoch0 = nepoch;
+		for (size_t i = 0; i < chunks.size(); i++) {
+			par_chunk* c = &chunks[i];
+			if (c->nepoch == 0) continue;
+
+			if (!started || c->disc_first != disc_last) {
+				ref_full_bias_nano = c->rows.full_bias_nano[0];
+				ref_bias_nano = c->rows.bias_nano[0];
+			}
+			started = true;
+			c->ref_full_bias_nano = ref_full_bias_nano;
+			c->ref_bias_nano = ref_bias_nano;
+			if (c->changed) {
+				ref_full_bias_nano = c->change_full_bias_nano;
+				ref_bias_nano = c->change_bias_nano;
+			}
+			disc_last = c->disc_last;
+
+			for (int s = 0; s < MAX_SYS; s++) {
+				for (int k = 0; k < c->sigs.nsignals[s]; k++) {
+					int sig = c->sigs.sig[s][k];
+					if (sigs.frq[sig] >= 0) continue;
+					sig_epoch[s][add_signal(&sigs, sig)] = nepoch + c->sig_epoch[s][k];
+				}
+			}
+			nepoch += c->nepoch;
+		}
+
+		// The conversion is timed as a whole; the writer times its own records
+		auto t_pass = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < chunks.size(); i++) {
+			par_chunk* c = &chunks[i];
+			pool->submit([c, &sigs] { convert_chunk(c, &sigs); });
+		}
+		pool->wait();
+		writer.stats.t_convert += elapsed_s(t_pass);
+		writer.stats.sigs = sigs;
+		for (size_t i = 0; i < chunks.size(); i++) add_stats(&writer.stats, &chunks[i].stats);
+
+		// Write the epochs in time order; each one needs the start of the next for the Galileo check
+		memcpy(writer.sigs.sig, sigs.sig, sizeof(sigs.sig));
+		int index = epoch0;
+		for (size_t i = 0; i < chunks.size() && !writer.failed; i++) {
+			for (size_t k = 0; k < chunks[i].epochs.size(); k++, index++) {
+				if (has_pending) {
+					for (int s = 0; s < MAX_SYS; s++) {
+						while (writer.sigs.nsignals[s] < sigs.nsignals[s] && sig_epoch[s][writer.sigs.nsignals[s]] <= pending_index)
+							writer.sigs.nsignals[s]++;
+					}
+					writer.first = false;
+					writer.repoch = std::move(pending);
+					writer.allRxMillis_p = writer.repoch.rx_millis;
+					close_epoch(&writer, chunks[i].epochs[k].rx_millis);
+				}
+				pending = std::move(chunks[i].epochs[k]);
+				pending_index = index;
+				has_pending = true;
+			}
+		}
+	}
+	log_close(&rd);
+	if (!read_ok) fprintf(stderr, "%s is corrupt; the epochs before that point are converted\n", infile);
+
+	// The last epoch is written with every signal, as is the header
+	if (has_pending) {
+		writer.first = false;
+		writer.sigs = sigs;
+		writer.repoch = std::move(pending);
+	}
+	bool ok = conv_finish(&writer) && read_ok;
+	if (!ok) fprintf(stderr, "Conversion of %s failed\n", infile);
+	take_stats(&writer, elapsed_s(t0), stats);
+	return ok;
+}
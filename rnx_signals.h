@@ -0,0 +1,109 @@
+/*
+// Signals that the converter recognises, and their classification.
+// A GnssLogger row is identified by its constellation type and its carrier
+// frequency rounded to whole MHz (the frequency bin); a table built at compile
+// time from sig_table maps the pair to the signal in O(1). The bins of every
+// band are at least 14 MHz apart, so a whole MHz is enough to tell them apart
+// within a constellation. CDMA signals must also be within SIG_TOL of their
+// nominal frequency, to which the reported frequency is then snapped; GLONASS
+// FDMA channels cover a range of bins and keep their own frequency.
+*/
+#ifndef RNX_SIGNALS_H
+#define RNX_SIGNALS_H
+
+#include <math.h>
+
+// GnssLogger constellation types, used as the systems of the output
+#define SYS_GPS 1
+#define SYS_GLO 3
+#define SYS_GAL 6
+#define SYS_BDS 5
+#define SYS_QZS 4
+#define SYS_IRN 7
+
+#define RNX_NSYS   6                    /* Systems of the output, in sys_code order: G R E C J I */
+#define SIG_NCONS  8                    /* Constellation types 0-7 */
+#define SIG_BIN0   1160                 /* Lowest frequency bin (MHz) */
+#define SIG_NBIN   460                  /* Bins 1160-1619 MHz; NavIC S band (2492 MHz) is not tracked by phones */
+#define SIG_TOL    5000.0               /* Largest offset of a CDMA carrier from its nominal frequency (Hz) */
+
+struct sig_def
+{
+	int sys;                 /* SYS_* */
+	int bin_lo, bin_hi;      /* Frequency bins of the signal (MHz) */
+	double freq;             /* Nominal frequency (Hz); 0 for FDMA, rounded to 100 Hz instead */
+	const char* code;        /* RINEX 3 observation code, without the observation type */
+};
+
+// Signals in the order in which they are listed when all are known in advance
+static constexpr sig_def sig_table[] = {
+	{ SYS_GPS, 1575, 1575, 1575420000.0, "1C" },   /* L1 C/A */
+	{ SYS_GPS, 1176, 1176, 1176450000.0, "5Q" },   /* L5 */
+	{ SYS_GPS, 1228, 1228, 1227600000.0, "2L" },   /* L2C */
+	{ SYS_GLO, 1598, 1606, 0.0, "1C" },            /* G1, channels -7 to +6 */
+	{ SYS_GLO, 1243, 1249, 0.0, "2C" },            /* G2 */
+	{ SYS_BDS, 1561, 1561, 1561098000.0, "2I" },   /* B1I */
+	{ SYS_BDS, 1176, 1176, 1176450000.0, "5P" },   /* B2a */
+	{ SYS_BDS, 1575, 1575, 1575420000.0, "1P" },   /* B1C */
+	{ SYS_BDS, 1207, 1207, 1207140000.0, "7I" },   /* B2I */
+	{ SYS_BDS, 1269, 1269, 1268520000.0, "6I" },   /* B3I */
+	{ SYS_GAL, 1575, 1575, 1575420000.0, "1C" },   /* E1 */
+	{ SYS_GAL, 1176, 1176, 1176450000.0, "5X" },   /* E5a */
+	{ SYS_GAL, 1207, 1207, 1207140000.0, "7X" },   /* E5b */
+	{ SYS_QZS, 1575, 1575, 1575420000.0, "1C" },   /* L1 C/A */
+	{ SYS_QZS, 1176, 1176, 1176450000.0, "5Q" },   /* L5 */
+	{ SYS_QZS, 1228, 1228, 1227600000.0, "2L" },   /* L2C */
+	{ SYS_IRN, 1176, 1176, 1176450000.0, "5A" },   /* NavIC L5 SPS */
+};
+
+#define SIG_COUNT ((int)(sizeof(sig_table) / sizeof(sig_table[0])))
+
+// Signal of each (constellation type, frequency bin), -1 if none
+struct sig_lut
+{
+	signed char sig[SIG_NCONS][SIG_NBIN];
+};
+
+static constexpr sig_lut make_sig_lut()
+{
+	sig_lut lut{};
+	for (int c = 0; c < SIG_NCONS; c++)
+		for (int b = 0; b < SIG_NBIN; b++) lut.sig[c][b] = -1;
+	for (int k = 0; k < SIG_COUNT; k++)
+		for (int b = sig_table[k].bin_lo; b <= sig_table[k].bin_hi; b++) lut.sig[sig_table[k].sys][b - SIG_BIN0] = (signed char)k;
+	return lut;
+}
+
+static constexpr sig_lut sig_index = make_sig_lut();
+
+// Signals of a system in sig_table
+static constexpr int sys_signals(int sys)
+{
+	int n = 0;
+	for (int k = 0; k < SIG_COUNT; k++) n += sig_table[k].sys == sys;
+	return n;
+}
+
+// SYS / # / OBS TYPES lines of a header listing every signal: 13 types per line,
+// 4 types (C, L, D, S) per signal
+static constexpr int rnx_sys_lines()
+{
+	const int sys[RNX_NSYS] = { SYS_GPS, SYS_GLO, SYS_GAL, SYS_BDS, SYS_QZS, SYS_IRN };
+	int n = 0;
+	for (int i = 0; i < RNX_NSYS; i++) n += (4 * sys_signals(sys[i]) + 12) / 13;
+	return n;
+}
+
+// Signal of a row from its constellation type and carrier frequency, -1 if unknown
+inline int lookup_signal(int cons, double freq)
+{
+	if (cons < 0 || cons >= SIG_NCONS || !(freq > 0.0)) return -1;
+	int bin = (int)(freq * 1e-6 + 0.5) - SIG_BIN0;
+	if (bin < 0 || bin >= SIG_NBIN) return -1;
+	int k = sig_index.sig[cons][bin];
+	if (k < 0) return -1;
+	if (sig_table[k].freq > 0.0 && fabs(freq - sig_table[k].freq) > SIG_TOL) return -1;
+	return k;
+}
+
+#endif
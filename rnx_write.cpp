@@ -0,0 +1,640 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "rnx_conv.h"
+#include "rnx_write.h"
+#include "spsc_queue.h"
+
+#define RNX_EPO_MAX   128               /* Longest epoch record */
+#define RNX_SAT_MAX   (16 + 4 * MAX_FRQ * RNX_FIELD_MAX + 1)  /* Longest satellite record */
+
+#define CRX_FIELDS    (4 * MAX_FRQ)     /* Observations of a satellite: C, L, D, S per signal */
+#define CRX_SAT_MAX   (CRX_FIELDS * 24 + 2 * CRX_FIELDS + 2)   /* Longest Compact RINEX data line */
+
+// Compact RINEX history of a satellite
+struct crx_sat
+{
+	int epoch;                          /* Last epoch written with the satellite, -1 if none */
+	int order[CRX_FIELDS];              /* Difference order reached along each arc, -1 if no arc */
+	long long diff[CRX_FIELDS][CRX_ORDER + 1];
+	char flags[2 * CRX_FIELDS + 1];     /* LLI and signal strength flags of that epoch */
+
+	crx_sat()
+	{
+		epoch = -1;
+		for (int f = 0; f < CRX_FIELDS; f++) order[f] = -1;
+		memset(diff, 0, sizeof(diff));
+		memset(flags, 0, sizeof(flags));
+	}
+};
+
+struct crx_state
+{
+	int nepoch;                         /* Epochs written */
+	std::string epoch_line;             /* Epoch line of the last one, with its satellite list */
+	std::vector<crx_sat> sats;          /* MAX_SYS x MAX_PRN */
+
+	crx_state()
+	{
+		nepoch = 0;
+		sats.resize(MAX_SYS * MAX_PRN);
+	}
+};
+
+// Writer thread of a file (pipeline). Blocks filled by put() go to the thread
+// through one queue and come back written through the other.
+struct rnx_pipe
+{
+	FILE* fp;
+	char* block[RNX_PBLOCKS];
+	size_t len[RNX_PBLOCKS];
+	spsc_queue<int, RNX_PBLOCKS> full;  /* Blocks to write, in file order */
+	spsc_queue<int, RNX_PBLOCKS> empty; /* Blocks written */
+	int cur;                            /* Block being filled, -1 if none */
+	size_t pushed;                      /* Blocks handed to the thread */
+	std::atomic<size_t> written;        /* Blocks the thread has written */
+	std::atomic<bool> failed;           /* A write failed */
+	unsigned long long write_stalls;    /* Waits of the thread for a block */
+	std::thread th;
+};
+
+static void write_run(rnx_pipe* p)
+{
+	int b;
+	unsigned long long unused = 0;
+	while (p->full.pop(&b, &p->write_stalls)) {
+		if (!p->failed && fwrite(p->block[b], 1, p->len[b], p->fp) != p->len[b]) p->failed = true;
+		p->written.fetch_add(1, std::memory_order_release);
+		p->empty.push(b, &unused);      /* Never waits: there are only RNX_PBLOCKS blocks */
+	}
+}
+
+// Hand the block being filled to the writer thread
+static void pipe_hand(rnx_writer* w)
+{
+	rnx_pipe* p = w->pipe;
+	p->full.push(p->cur, &w->put_stalls);
+	p->pushed++;
+	p->cur = -1;
+}
+
+static bool pipe_put(rnx_writer* w, const char* data, size_t len)
+{
+	rnx_pipe* p = w->pipe;
+	while (len > 0) {
+		if (p->cur < 0) {
+			p->empty.pop(&p->cur, &w->put_stalls);
+			p->len[p->cur] = 0;
+		}
+		size_t k = RNX_PBLOCK - p->len[p->cur];
+		if (k > len) k = len;
+		memcpy(p->block[p->cur] + p->len[p->cur], data, k);
+		p->len[p->cur] += k;
+		data += k;
+		len -= k;
+		if (p->len[p->cur] == RNX_PBLOCK) pipe_hand(w);
+	}
+	return !p->failed;
+}
+
+// Hand over what put() has collected and wait until the thread has written it
+// all; until the next put() the file is left to the calling thread
+static bool pipe_drain(rnx_writer* w)
+{
+	rnx_pipe* p = w->pipe;
+	if (p->cur >= 0 && p->len[p->cur] > 0) pipe_hand(w);
+	for (int round = 0; p->written.load(std::memory_order_acquire) != p->pushed; round++) {
+		if (round == 0) w->put_stalls++;
+		if (round > SPSC_SPINS + SPSC_YIELDS) round--;
+		spsc_backoff(round);
+	}
+	return !p->failed;
+}
+
+static void stop_pipe(rnx_writer* w)
+{
+	rnx_pipe* p = w->pipe;
+	if (!pipe_drain(w)) w->failed = true;
+	p->full.close();
+	p->th.join();
+	w->write_stalls = p->write_stalls;
+	for (int i = 0; i < RNX_PBLOCKS; i++) free(p->block[i]);
+	delete p;
+	w->pipe = NULL;
+}
+
+bool rnx_gzip_supported()
+{
+#ifdef HAVE_ZLIB
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool rnx_writer_open(rnx_writer* w, FILE* fp, int format)
+{
+	memset(w, 0, sizeof(rnx_writer));
+	w->fp = fp;
+	w->format = format;
+	w->buf = (char*)malloc(RNX_BUFSIZE);
+	if (!w->buf) return false;
+	w->cap = RNX_BUFSIZE;
+
+	if (format & RNX_FMT_CRX) {
+		w->crx = new crx_state();
+		time_t now = time(NULL);
+		strftime(w->crx_date, sizeof(w->crx_date), "%d-%b-%y %H:%M", gmtime(&now));
+	}
+	if (format & RNX_FMT_GZ) {
+#ifdef HAVE_ZLIB
+		z_stream* zs = new z_stream();
+		w->zs = zs;
+		w->zbuf = (char*)malloc(RNX_ZBUFSIZE);
+		if (!w->zbuf || deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			delete zs;
+			w->zs = NULL;
+			return false;
+		}
+#else
+		fprintf(stderr, "gzip output needs a build with zlib (HAVE_ZLIB)\n");
+		return false;
+#endif
+	}
+	return true;
+}
+
+// Output going to a callback instead of a file
+bool rnx_writer_open_stream(rnx_writer* w, rnx_out_fn out, void* user, int format)
+{
+	bool ok = rnx_writer_open(w, NULL, format);
+	w->out = out;
+	w->out_user = user;
+	return ok;
+}
+
+// Hand bytes to the file, its writer thread or the output callback
+static bool put(rnx_writer* w, const void* data, size_t len)
+{
+	if (w->out) return w->out(w->out_user, (const char*)data, len);
+	if (w->pipe) return pipe_put(w, (const char*)data, len);
+	return fwrite(data, 1, len, w->fp) == len;
+}
+
+// Write the file from a thread of its own from now on (pipeline)
+bool rnx_writer_start_thread(rnx_writer* w)
+{
+	if (!w->fp || w->pipe) return w->fp != NULL;
+	rnx_pipe* p = new rnx_pipe();
+	p->fp = w->fp;
+	p->cur = -1;
+	p->pushed = 0;
+	p->written = 0;
+	p->failed = false;
+	for (int i = 0; i < RNX_PBLOCKS; i++) {
+		p->block[i] = (char*)malloc(RNX_PBLOCK);
+		if (!p->block[i]) {
+			for (int k = 0; k < i; k++) free(p->block[k]);
+			delete p;
+			return false;
+		}
+		p->empty.try_push(i);
+	}
+	p->th = std::thread(write_run, p);
+	w->pipe = p;
+	return true;
+}
+
+// Hand data to the file, through the deflate stream in gzip format
+static bool sink(rnx_writer* w, const char* data, size_t len, int flush)
+{
+#ifdef HAVE_ZLIB
+	if (w->zs) {
+		z_stream* zs = (z_stream*)w->zs;
+		zs->next_in = (Bytef*)data;
+		zs->avail_in = (uInt)len;
+		do {
+			zs->next_out = (Bytef*)w->zbuf;
+			zs->avail_out = RNX_ZBUFSIZE;
+			if (deflate(zs, flush) == Z_STREAM_ERROR) return false;
+			size_t n = RNX_ZBUFSIZE - zs->avail_out;
+			if (n > 0 && !put(w, w->zbuf, n)) return false;
+		} while (zs->avail_out == 0);
+		return true;
+	}
+#endif
+	(void)flush;
+	return len == 0 || put(w, data, len);
+}
+
+#ifdef HAVE_ZLIB
+// Little-endian 32-bit field of the gzip trailer
+static void put_le32(unsigned char* p, unsigned long v)
+{
+	p[0] = (unsigned char)v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+#endif
+
+// Write the header at the start of the file, or over the previous one, which
+// must have the same length. In gzip format the header is a member of its own,
+// stored uncompressed, so that it can be rewritten along with its CRC.
+bool rnx_writer_header(rnx_writer* w, const char* text, size_t len)
+{
+	if (w->failed) return false;
+
+	std::string header;
+	if (w->format & RNX_FMT_CRX) {
+		char line[128];
+		sprintf(line, "%-20s%-40s%-20s\n", "3.0", "COMPACT RINEX FORMAT", "CRINEX VERS   / TYPE");
+		header += line;
+		sprintf(line, "%-40s%-20s%-20s\n", "CSV2RINEX", w->crx_date, "CRINEX PROG / DATE");
+		header += line;
+	}
+	header.append(text, len);
+
+	if (w->header_len > 0 && header.size() != w->header_len) {
+		w->failed = true;
+		return false;
+	}
+	bool first = w->header_len == 0;
+	if (first) w->header_len = header.size();
+	else if (w->out) return true;       /* A stream keeps its first header */
+	if (w->pipe && !pipe_drain(w)) {    /* The file position is needed, or the file is rewritten */
+		w->failed = true;
+		return false;
+	}
+
+	if (w->format & RNX_FMT_GZ) {
+#ifdef HAVE_ZLIB
+		unsigned char crc[4];
+		put_le32(crc, crc32(0L, (const Bytef*)header.data(), (uInt)header.size()));
+		if (first) {
+			size_t n = header.size();
+			unsigned char head[15] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff,  /* gzip member header */
+				0x01, (unsigned char)n, (unsigned char)(n >> 8),                  /* final stored block */
+				(unsigned char)~n, (unsigned char)(~n >> 8) };
+			unsigned char size[4];
+			put_le32(size, (unsigned long)n);
+			w->header_pos = sizeof(head);
+			w->crc_pos = w->header_pos + (long)n;
+			if (!put(w, head, sizeof(head)) || !put(w, header.data(), n) ||
+				!put(w, crc, 4) || !put(w, size, 4)) w->failed = true;
+		}
+		else {
+			fflush(w->fp);
+			if (fseek(w->fp, w->header_pos, SEEK_SET) != 0 ||
+				fwrite(header.data(), 1, header.size(), w->fp) != header.size() ||
+				fseek(w->fp, w->crc_pos, SEEK_SET) != 0 ||
+				fwrite(crc, 1, 4, w->fp) != 4) w->failed = true;
+			fseek(w->fp, 0, SEEK_END);
+		}
+#endif
+		return !w->failed;
+	}
+
+	if (first) {
+		w->header_pos = w->fp ? ftell(w->fp) : 0;
+		if (!put(w, header.data(), header.size())) w->failed = true;
+	}
+	else {
+		fflush(w->fp);
+		if (fseek(w->fp, w->header_pos, SEEK_SET) != 0 ||
+			fwrite(header.data(), 1, header.size(), w->fp) != header.size()) w->failed = true;
+		fseek(w->fp, 0, SEEK_END);
+	}
+	return !w->failed;
+}
+
+// Hand the buffered records to the file
+bool rnx_writer_flush(rnx_writer* w)
+{
+	if (w->len > 0 && !w->failed) {
+		if (!sink(w, w->buf, w->len, 0)) w->failed = true;
+	}
+	w->len = 0;
+	return !w->failed;
+}
+
+// Flush the records so that a reader of the file sees every one of them
+bool rnx_writer_sync(rnx_writer* w)
+{
+	if (!rnx_writer_flush(w)) return false;
+#ifdef HAVE_ZLIB
+	if (w->zs && !sink(w, NULL, 0, Z_SYNC_FLUSH)) w->failed = true;
+#endif
+	if (w->pipe && !pipe_drain(w)) w->failed = true;
+	if (w->fp && fflush(w->fp) != 0) w->failed = true;
+	return !w->failed;
+}
+
+// Flush the records and end the compressed stream
+bool rnx_writer_close(rnx_writer* w)
+{
+	rnx_writer_flush(w);
+#ifdef HAVE_ZLIB
+	if (w->zs) {
+		z_stream* zs = (z_stream*)w->zs;
+		if (!w->failed && !sink(w, NULL, 0, Z_FINISH)) w->failed = true;
+		deflateEnd(zs);
+		delete zs;
+		w->zs = NULL;
+	}
+#endif
+	if (w->pipe) stop_pipe(w);
+	free(w->zbuf);
+	w->zbuf = NULL;
+	delete w->crx;
+	w->crx = NULL;
+	free(w->buf);
+	w->buf = NULL;
+	w->cap = 0;
+	return !w->failed;
+}
+
+// Make room for n more bytes, writing out the buffer if it is full
+static bool reserve(rnx_writer* w, size_t n)
+{
+	if (w->len + n <= w->cap) return true;
+	return rnx_writer_flush(w);
+}
+
+// Append text of any other kind (navigation records, CSV lines) to the output
+bool rnx_writer_text(rnx_writer* w, const char* text, size_t len)
+{
+	if (w->failed || !reserve(w, len)) return false;
+	if (len > w->cap) {
+		if (!sink(w, text, len, 0)) w->failed = true;
+		return !w->failed;
+	}
+	memcpy(w->buf + w->len, text, len);
+	w->len += len;
+	return true;
+}
+
+// Format v with printf("%*.3lf", width, v)
+static char* put_fixed3_printf(char* p, double v, int width)
+{
+	return p + sprintf(p, "%*.3lf", width, v);
+}
+
+// Format v as printf("%*.3lf", width, v) does. The value is scaled to an integer
+// number of thousandths; values so close to a rounding tie that the scaling
+// could change the result, and values too large for an exact scaling, are left
+// to printf.
+char* rnx_put_fixed3(char* p, double v, int width)
+{
+	double s = fabs(v) * 1000.0;
+	double r = floor(s);
+	if (!(s < 1e12) || fabs(s - r - 0.5) < 1e-3) return put_fixed3_printf(p, v, width);
+
+	unsigned long long n = (unsigned long long)r + (s - r > 0.5 ? 1 : 0);
+	char digits[32];
+	int k = 0;
+	for (int i = 0; i < 3; i++, n /= 10) digits[k++] = (char)('0' + n % 10);
+	digits[k++] = '.';
+	do {
+		digits[k++] = (char)('0' + n % 10);
+		n /= 10;
+	} while (n);
+	if (std::signbit(v)) digits[k++] = '-';
+
+	for (int i = k; i < width; i++) *p++ = ' ';
+	while (k > 0) *p++ = digits[--k];
+
+	return p;
+}
+
+static char* put_blank(char* p, int n)
+{
+	memset(p, ' ', n);
+	return p + n;
+}
+
+// Observation field "%14.3lf  ", blank if there is no observation
+char* rnx_put_obs(char* p, double v)
+{
+	if (!v) return put_blank(p, RNX_FIELD);
+	p = rnx_put_fixed3(p, v, 14);
+	return put_blank(p, 2);
+}
+
+// Phase field: "%13.3lf%1d" with the LLI, cut to 14 characters and right aligned in 14
+char* rnx_put_phase(char* p, double v, int lli)
+{
+	if (!v) return put_blank(p, 14);
+
+	char field[RNX_FIELD_MAX];
+	char* e = rnx_put_fixed3(field, v, 13);
+	*e++ = (char)('0' + lli);
+	int n = (int)(e - field);
+	if (n > 14) n = 14;
+	p = put_blank(p, 14 - n);
+	memcpy(p, field, n);
+	return p + n;
+}
+
+// Satellite "%c%02d"
+static char* put_sat(char* p, char sys, int prn)
+{
+	if (prn < 0 || prn > 99) return p + sprintf(p, "%c%02d", sys, prn);
+	*p++ = sys;
+	*p++ = (char)('0' + prn / 10);
+	*p++ = (char)('0' + prn % 10);
+	return p;
+}
+
+// RINEX 3 observation records of an epoch
+static void print_obs_epoch(rnx_writer* w, const signal_set* ss, const rnx_epoch& e)
+{
+	if (!reserve(w, RNX_EPO_MAX)) {
+		w->failed = true;
+		return;
+	}
+	w->len += sprintf(w->buf + w->len, "> %04d %02d %02d %02d %02d %10.7lf  0 %2d\n",
+		(int)e.time[0], (int)e.time[1], (int)e.time[2], (int)e.time[3],
+		(int)e.time[4], e.time[5], e.sv);
+
+	for (auto it = e.sats.begin(); it != e.sats.end(); it++)
+	{
+		if (!reserve(w, RNX_SAT_MAX)) {
+			w->failed = true;
+			return;
+		}
+		char* p = w->buf + w->len;
+
+		int sys_n = sys_code_function(it->sys);
+		p = put_sat(p, sys_code[sys_n], it->prn);
+		int nsig = ss->nsignals[sys_n];
+
+		for (int i = 0; i < nsig; i++)
+		{
+			p = rnx_put_obs(p, it->p[i]);
+			p = rnx_put_phase(p, it->l[i], it->lli[i] & (LLI_SLIP | LLI_HALFC | LLI_BOCTRK));
+			p = rnx_put_obs(p, it->d[i]);
+			p = rnx_put_obs(p, it->s[i]);
+		}
+		*p++ = '\n';
+		w->len = p - w->buf;
+	}
+}
+
+// Integer value of an observation as written with 3 decimals, i.e. in thousandths
+static long long fixed3_int(double v)
+{
+	char field[RNX_FIELD_MAX];
+	char* e = rnx_put_fixed3(field, v, 0);
+	long long n = 0;
+	bool neg = false;
+	for (char* p = field; p < e; p++) {
+		if (*p == '-') neg = true;
+		else if (*p >= '0' && *p <= '9') n = n * 10 + (*p - '0');
+	}
+	return neg ? -n : n;
+}
+
+// Text difference of line s against the previous line s0, as in Compact RINEX:
+// a space for an unchanged character, '&' for a character that became a space.
+// Trailing spaces are dropped.
+static std::string crx_strdiff(const char* s0, const char* s)
+{
+	std::string d;
+	for (; *s; s++) {
+		if (*s0) {
+			if (*s == *s0) d += ' ';
+			else d += *s == ' ' ? '&' : *s;
+			s0++;
+		}
+		else d += *s == ' ' ? '&' : *s;
+	}
+	for (; *s0; s0++) d += '&';
+	while (!d.empty() && d.back() == ' ') d.pop_back();
+	return d;
+}
+
+static crx_sat* find_crx_sat(crx_state* cs, int sys, int prn)
+{
+	int sys_n = sys_code_function(sys);
+	if (sys_n < 0 || prn < 0 || prn >= MAX_PRN) return NULL;
+	return &cs->sats[sys_n * MAX_PRN + prn];
+}
+
+// Compact RINEX 3 records of an epoch. The epoch line (with the satellite list)
+// is given as its difference to the previous one; each observation as the
+// CRX_ORDER-th difference along its arc, an arc starting with "3&" and the value;
+// the flags as a text difference to those of the satellite's previous epoch.
+static void print_crx_epoch(rnx_writer* w, const signal_set* ss, const rnx_epoch& e)
+{
+	crx_state* cs = w->crx;
+
+	char head[64];
+	sprintf(head, "> %04d %02d %02d %02d %02d %10.7lf  0 %2d      ",
+		(int)e.time[0], (int)e.time[1], (int)e.time[2], (int)e.time[3],
+		(int)e.time[4], e.time[5], e.sv);
+	std::string line = head;
+	for (auto it = e.sats.begin(); it != e.sats.end(); it++) {
+		char id[16];
+		sprintf(id, "%c%02d", sys_code[sys_code_function(it->sys)], it->prn);
+		line += id;
+	}
+	std::string epoch = cs->nepoch == 0 ? line : crx_strdiff(cs->epoch_line.c_str(), line.c_str());
+	cs->epoch_line = line;
+
+	if (!reserve(w, epoch.size() + 2)) {
+		w->failed = true;
+		return;
+	}
+	memcpy(w->buf + w->len, epoch.data(), epoch.size());
+	w->len += epoch.size();
+	w->buf[w->len++] = '\n';
+	w->buf[w->len++] = '\n';          /* No receiver clock offset */
+
+	for (auto it = e.sats.begin(); it != e.sats.end(); it++)
+	{
+		if (!reserve(w, CRX_SAT_MAX)) {
+			w->failed = true;
+			return;
+		}
+		char* p = w->buf + w->len;
+
+		int sys_n = sys_code_function(it->sys);
+		int nfield = 4 * ss->nsignals[sys_n];
+		crx_sat* h = find_crx_sat(cs, it->sys, it->prn);
+		bool cont = h && h->epoch >= 0 && h->epoch == cs->nepoch - 1;  /* Arcs continue from the previous epoch */
+
+		char flags[2 * CRX_FIELDS + 1];
+		for (int f = 0; f < nfield; f++)
+		{
+			int i = f / 4;
+			double v = f % 4 == 0 ? it->p[i] : f % 4 == 1 ? it->l[i] : f % 4 == 2 ? it->d[i] : it->s[i];
+			flags[2 * f] = ' ';
+			flags[2 * f + 1] = ' ';
+			if (f > 0) *p++ = ' ';
+			if (!v) {
+				if (h) h->order[f] = -1;
+				continue;
+			}
+			if (f % 4 == 1) flags[2 * f] = (char)('0' + (it->lli[i] & (LLI_SLIP | LLI_HALFC | LLI_BOCTRK)));
+
+			long long y = fixed3_int(v);
+			if (cont && h->order[f] >= 0) {
+				int k = h->order[f] < CRX_ORDER ? h->order[f] + 1 : CRX_ORDER;
+				long long d[CRX_ORDER + 1];
+				d[0] = y;
+				for (int j = 1; j <= k; j++) d[j] = d[j - 1] - h->diff[f][j - 1];
+				memcpy(h->diff[f], d, sizeof(long long) * (k + 1));
+				h->order[f] = k;
+				p += sprintf(p, "%lld", d[k]);
+			}
+			else {
+				if (h) {
+					h->order[f] = 0;
+					h->diff[f][0] = y;
+				}
+				p += sprintf(p, "%d&%lld", CRX_ORDER, y);
+			}
+		}
+		flags[2 * nfield] = '\0';
+
+		// Flags of a satellite without history are given in full
+		std::string fd;
+		if (cont) fd = crx_strdiff(h->flags, flags);
+		else {
+			fd = flags;
+			for (size_t k = 0; k < fd.size(); k++) if (fd[k] == ' ') fd[k] = '&';
+		}
+		*p++ = ' ';
+		memcpy(p, fd.data(), fd.size());
+		p += fd.size();
+		while (p > w->buf + w->len && p[-1] == ' ') p--;
+		*p++ = '\n';
+		w->len = p - w->buf;
+
+		if (h) {
+			h->epoch = cs->nepoch;
+			strcpy(h->flags, flags);
+			for (int f = nfield; f < CRX_FIELDS; f++) h->order[f] = -1;
+		}
+	}
+	cs->nepoch++;
+}
+
+void print_rnx_epoch(rnx_writer* w, const signal_set* ss, const rnx_epoch& e)
+{
+	if (w->crx) print_crx_epoch(w, ss, e);
+	else print_obs_epoch(w, ss, e);
+}
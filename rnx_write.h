@@ -0,0 +1,86 @@
+/*
+// Buffered writer for RINEX observation records.
+// Epochs are formatted into one large buffer with dedicated fixed-width field
+// routines and handed to the file in a single write per buffer. The output is
+// byte for byte that of the former fprintf formatting (bench/check_fields.cpp
+// compares the field routines against printf).
+// The records can also be written as Compact RINEX 3 (Hatanaka differences)
+// and/or compressed with gzip on the fly (builds with HAVE_ZLIB).
+// Instead of a file, the output can go to a callback (rnx_writer_open_stream);
+// a stream cannot be rewound, so its header is written once and never updated.
+// In pipeline mode the file is written by a writer thread of its own: the output
+// is handed over in large blocks through a lock-free queue, and formatting goes
+// on while the previous blocks are written.
+*/
+#ifndef RNX_WRITE_H
+#define RNX_WRITE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define RNX_BUFSIZE  (1 << 20)          /* Output buffer, written to the file when full */
+#define RNX_ZBUFSIZE (1 << 18)          /* Compressed output per deflate call */
+#define RNX_PBLOCK   (1 << 22)          /* Bytes handed to the writer thread at a time (pipeline) */
+#define RNX_PBLOCKS  4                  /* Blocks in flight between the writer and its thread */
+
+#define RNX_FIELD     16                /* Width of an observation field, value and LLI/SSI */
+#define RNX_FIELD_MAX 330               /* Longest field printf can produce for a double */
+
+#define RNX_FMT_CRX  0x01               /* Compact RINEX 3 (.YYd) */
+#define RNX_FMT_GZ   0x02               /* gzip compressed (.gz) */
+
+#define CRX_ORDER    3                  /* Order of the differences along a Compact RINEX arc */
+
+// Output callback of a stream: false stops the conversion
+typedef bool (*rnx_out_fn)(void* user, const char* data, size_t len);
+
+struct rnx_epoch;
+struct signal_set;
+struct crx_state;
+struct rnx_pipe;
+
+struct rnx_writer
+{
+	FILE* fp;
+	rnx_out_fn out;      /* Stream: receives the output instead of fp */
+	void* out_user;
+	char* buf;
+	size_t len;          /* Bytes waiting in buf */
+	size_t cap;
+	bool failed;         /* A write to the file failed */
+	int format;          /* RNX_FMT_* */
+
+	// Header, written again in place as more signals are found
+	long header_pos;     /* File offset of the header text */
+	size_t header_len;   /* Length of the header text, 0 until it is written */
+	long crc_pos;        /* gzip: offset of the CRC of the header member */
+	char crx_date[24];   /* Compact RINEX: date of the CRINEX PROG / DATE record */
+
+	crx_state* crx;      /* Compact RINEX: previous epoch line and satellite arcs */
+	void* zs;            /* gzip: deflate stream of the records */
+	char* zbuf;
+
+	// Pipeline: writer thread of the file
+	rnx_pipe* pipe;      /* Writer thread and its blocks, NULL to write in place */
+	unsigned long long put_stalls;   /* Waits for the writer thread to take or write a block */
+	unsigned long long write_stalls; /* Waits of the writer thread for a block (set at close) */
+};
+
+bool rnx_writer_open(rnx_writer* w, FILE* fp, int format);
+bool rnx_writer_open_stream(rnx_writer* w, rnx_out_fn out, void* user, int format);
+bool rnx_writer_start_thread(rnx_writer* w);
+bool rnx_writer_header(rnx_writer* w, const char* text, size_t len);
+bool rnx_writer_text(rnx_writer* w, const char* text, size_t len);
+bool rnx_writer_flush(rnx_writer* w);
+bool rnx_writer_sync(rnx_writer* w);
+bool rnx_writer_close(rnx_writer* w);
+bool rnx_gzip_supported();
+
+// Fixed-width fields of the observation records
+char* rnx_put_fixed3(char* p, double v, int width);
+char* rnx_put_obs(char* p, double v);
+char* rnx_put_phase(char* p, double v, int lli);
+
+void print_rnx_epoch(rnx_writer* w, const signal_set* ss, const rnx_epoch& e);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+// Bounded lock-free queue between one producer thread and one consumer thread.
+// Each side writes only its own index, so the ring needs no lock, only acquire
+// and release ordering on the indices. A side that finds the ring full (or
+// empty) polls, then yields, then sleeps, and counts the wait as a stall: the
+// stall counters of a pipeline tell which stage holds up the others.
+*/
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stddef.h>
+
+#define SPSC_SPINS    64                /* Polls before a waiting side yields */
+#define SPSC_YIELDS   64                /* Yields before it sleeps */
+#define SPSC_SLEEP_US 50                /* Sleep between polls after that */
+
+// Back off while waiting for the other side; round counts the polls so far
+inline void spsc_backoff(int round)
+{
+	if (round < SPSC_SPINS) return;
+	if (round < SPSC_SPINS + SPSC_YIELDS) std::this_thread::yield();
+	else std::this_thread::sleep_for(std::chrono::microseconds(SPSC_SLEEP_US));
+}
+
+template <class T, size_t N>
+struct spsc_queue
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "the capacity must be a power of 2");
+
+	T item[N];
+	alignas(64) std::atomic<size_t> head;   /* Items popped, written by the consumer */
+	alignas(64) std::atomic<size_t> tail;   /* Items pushed, written by the producer */
+	alignas(64) std::atomic<bool> closed;   /* One side has finished */
+
+	spsc_queue() : head(0), tail(0), closed(false) {}
+
+	bool try_push(const T& v)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) return false;
+		item[t & (N - 1)] = v;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T* v)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*v = item[h & (N - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Push, waiting for room; false if the queue is closed meanwhile (the consumer gave up)
+	bool push(const T& v, unsigned long long* stalls)
+	{
+		for (int round = 0; !try_push(v); round++) {
+			if (closed.load(std::memory_order_acquire)) return false;
+			if (round == 0) (*stalls)++;
+			if (round > SPSC_SPINS + SPSC_YIELDS) round--;  /* Keep sleeping without overflow */
+			spsc_backoff(round);
+		}
+		return true;
+	}
+
+	// Pop, waiting for an item; false once the queue is closed and empty
+	bool pop(T* v, unsigned long long* stalls)
+	{
+		for (int round = 0; !try_pop(v); round++) {
+			if (closed.load(std::memory_order_acquire)) return try_pop(v);
+			if (round == 0) (*stalls)++;
+			if (round > SPSC_SPINS + SPSC_YIELDS) round--;  /* Keep sleeping without overflow */
+			spsc_backoff(round);
+		}
+		return true;
+	}
+
+	void close() { closed.store(true, std::memory_order_release); }
+};
+
+#endif
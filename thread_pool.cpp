@@ -0,0 +1,97 @@
+#include "thread_pool.h"
+
+thread_pool::thread_pool(int nthreads)
+{
+	if (nthreads < 1) nthreads = 1;
+	next = 0;
+	queued = 0;
+	pending = 0;
+	stop = false;
+
+	for (int i = 0; i < nthreads; i++)
+		queues.push_back(new job_queue());
+	for (int i = 0; i < nthreads; i++)
+		workers.push_back(std::thread(&thread_pool::run, this, i));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		stop = true;
+	}
+	work_cv.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+void thread_pool::submit(std::function<void()> job)
+{
+	int id = next++ % (int)queues.size();
+	{
+		std::lock_guard<std::mutex> lk(queues[id]->lock);
+		queues[id]->jobs.push_back(std::move(job));
+	}
+	{
+		std::lock_guard<std::mutex> lk(lock);
+		queued++;
+		pending++;
+	}
+	work_cv.notify_one();
+}
+
+void thread_pool::wait()
+{
+	std::unique_lock<std::mutex> lk(lock);
+	done_cv.wait(lk, [this] { return pending == 0; });
+}
+
+// Take a job from the own queue, or steal one from another worker
+bool thread_pool::pop(int id, std::function<void()>& job)
+{
+	int n = (int)queues.size();
+	for (int i = 0; i < n; i++) {
+		job_queue* q = queues[(id + i) % n];
+		std::lock_guard<std::mutex> lk(q->lock);
+		if (q->jobs.empty()) continue;
+		if (i == 0) {
+			job = std::move(q->jobs.front());
+			q->jobs.pop_front();
+		}
+		else {
+			job = std::move(q->jobs.back());
+			q->jobs.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+void thread_pool::run(int id)
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lk(lock);
+			work_cv.wait(lk, [this] { return stop || queued > 0; });
+			if (queued == 0) return; /* Stopping and nothing left */
+			queued--;
+		}
+
+		// A job is reserved for this worker, so one of the queues holds it
+		std::function<void()> job;
+		while (!pop(id, job))
+			std::this_thread::yield();
+		job();
+
+		std::lock_guard<std::mutex> lk(lock);
+		if (--pending == 0) done_cv.notify_all();
+	}
+}
+
+int default_threads()
+{
+	int n = (int)std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
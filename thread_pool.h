@@ -0,0 +1,52 @@
+/*
+// Work-stealing thread pool.
+// Every worker owns a queue; jobs are dealt round robin. A worker takes jobs
+// from the front of its own queue and, once that is empty, steals from the
+// back of the other queues, so one long job never holds up the rest.
+*/
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct thread_pool
+{
+	thread_pool(int nthreads);
+	~thread_pool();
+
+	void submit(std::function<void()> job);
+	void wait();                 /* Block until every submitted job has finished */
+	int  size() const { return (int)workers.size(); }
+
+private:
+	struct job_queue
+	{
+		std::mutex lock;
+		std::deque<std::function<void()> > jobs;
+	};
+
+	bool pop(int id, std::function<void()>& job);
+	void run(int id);
+
+	std::vector<std::thread> workers;
+	std::vector<job_queue*> queues;
+	std::atomic<int> next;       /* Queue for the next submitted job */
+
+	std::mutex lock;             /* Guards the counters below for the condition variables */
+	std::condition_variable work_cv;
+	std::condition_variable done_cv;
+	int queued;                  /* Jobs not yet taken by a worker */
+	int pending;                 /* Jobs not yet finished */
+	bool stop;
+};
+
+// Number of worker threads to use when none is given
+int default_threads();
+
+#endif